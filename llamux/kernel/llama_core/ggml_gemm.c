@@ -0,0 +1,141 @@
+/*
+ * Blocked F32 GEMM driver for batched prefill
+ *
+ * Decode (one token) is a GEMV and stays on the dot-product loops in
+ * ggml_kernel.c. Once a prompt brings several activation columns, each
+ * weight row is reused across all of them, so the matmul becomes compute
+ * bound and the packed micro-kernel in ggml_gemm.h pays off.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include "ggml_gemm.h"
+#include "ggml_simd.h"
+#include "quantize.h"
+#include "llama_fpu.h"
+
+/* Use the blocked GEMM once a matmul has at least this many columns */
+static int gemm_min_cols = 4;
+module_param(gemm_min_cols, int, 0644);
+MODULE_PARM_DESC(gemm_min_cols, "Min activation columns for blocked GEMM (0=never)");
+
+bool ggml_gemm_wanted(long n_cols) {
+    return gemm_min_cols > 0 && n_cols >= gemm_min_cols;
+}
+
+/* Unblocked fallback when the pack buffers can't be allocated */
+static void ggml_gemm_f32_simple(int M, int N, int K,
+                                 const float *A, int lda,
+                                 const float *B, int ldb,
+                                 float *C, int ldc) {
+    struct llama_fpu_region fpu = { 0 };
+
+    llama_fpu_begin(&fpu);
+    for (int i = 0; i < M; i++) {
+        for (int j = 0; j < N; j++) {
+            C[(long)i * ldc + j] = ggml_vec_dot_f32(A + (long)i * lda,
+                                                    B + (long)j * ldb, K);
+        }
+        llama_fpu_checkpoint(&fpu);
+    }
+    llama_fpu_end(&fpu);
+}
+
+/* C[i][j] = sum_k A[i][k] * B[j][k] */
+void ggml_gemm_f32(int M, int N, int K,
+                   const float *A, int lda,
+                   const float *B, int ldb,
+                   float *C, int ldc) {
+    struct llama_fpu_region fpu = { 0 };
+    float *Ap, *Bp;
+
+    Ap = kvmalloc_array(GGML_GEMM_MC * GGML_GEMM_KC, sizeof(float), GFP_KERNEL);
+    Bp = kvmalloc_array(GGML_GEMM_KC * GGML_GEMM_NC, sizeof(float), GFP_KERNEL);
+    if (!Ap || !Bp) {
+        pr_err("🦙 GEMM: Failed to allocate pack buffers, using simple path\n");
+        ggml_gemm_f32_simple(M, N, K, A, lda, B, ldb, C, ldc);
+        goto out;
+    }
+
+    /* One FPU region for the whole product, yielding between blocks */
+    llama_fpu_begin(&fpu);
+    for (int jc = 0; jc < N; jc += GGML_GEMM_NC) {
+        const int nc = min(GGML_GEMM_NC, N - jc);
+
+        for (int pc = 0; pc < K; pc += GGML_GEMM_KC) {
+            const int kc = min(GGML_GEMM_KC, K - pc);
+
+            ggml_gemm_pack_b(B + (long)jc * ldb + pc, ldb, nc, kc, Bp);
+
+            for (int ic = 0; ic < M; ic += GGML_GEMM_MC) {
+                const int mc = min(GGML_GEMM_MC, M - ic);
+
+                ggml_gemm_pack_a(A + (long)ic * lda + pc, lda, mc, kc, Ap);
+                ggml_gemm_block(mc, nc, kc, Ap, Bp,
+                                C + (long)ic * ldc + jc, ldc, pc > 0);
+                llama_fpu_checkpoint(&fpu);
+            }
+        }
+    }
+    llama_fpu_end(&fpu);
+
+out:
+    kvfree(Bp);
+    kvfree(Ap);
+}
+
+static void ggml_gemm_dequant(const struct ggml_gemm_qa *qa, const void *x,
+                              float *y, int k) {
+    dequantize_row(x, y, k, qa->type);
+}
+
+static void ggml_gemm_yield(void *fpu) {
+    llama_fpu_checkpoint(fpu);
+}
+
+/*
+ * C[i][j] = sum_k A[i][k] * B[j][k] with A quantized; see
+ * ggml_gemm_q_blocked() for the blocking.
+ *
+ * Returns -ENOMEM if the buffers can't be allocated; C is untouched then
+ * and the caller should fall back to the per-row path.
+ */
+int ggml_gemm_q_f32(int M, int N, int K,
+                    const void *Aq, size_t row_bytes, enum ggml_type type,
+                    const float *B, int ldb,
+                    float *C, int ldc) {
+    struct llama_fpu_region fpu = { 0 };
+    const struct ggml_gemm_qa qa = {
+        .data = Aq,
+        .row_bytes = row_bytes,
+        .kc_bytes = gguf_tensor_size(type, GGML_GEMM_KC),
+        .dequant = ggml_gemm_dequant,
+        .type = type,
+    };
+    float *panel, *Ap, *Bp;
+    int ret = 0;
+
+    if (!qa.kc_bytes)
+        return -EINVAL;
+
+    panel = kvmalloc_array(GGML_GEMM_MC * GGML_GEMM_KC, sizeof(float), GFP_KERNEL);
+    Ap = kvmalloc_array(GGML_GEMM_MC * GGML_GEMM_KC, sizeof(float), GFP_KERNEL);
+    Bp = kvmalloc_array(GGML_GEMM_KC * GGML_GEMM_NC, sizeof(float), GFP_KERNEL);
+    if (!panel || !Ap || !Bp) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    llama_fpu_begin(&fpu);
+    ggml_gemm_q_blocked(&qa, M, N, K, B, ldb, C, ldc, panel, Ap, Bp,
+                        ggml_gemm_yield, &fpu);
+    llama_fpu_end(&fpu);
+
+out:
+    kvfree(Bp);
+    kvfree(Ap);
+    kvfree(panel);
+    return ret;
+}
@@ -0,0 +1,189 @@
+/*
+ * Packed-panel F32 GEMM for Llamux
+ *
+ * Computes C[i][j] = sum_k A[i][k] * B[j][k] where A is the weight matrix
+ * (M rows of K) and B holds the prompt activations (N columns of K), the
+ * layout every MUL_MAT in this tree uses.
+ *
+ * A and B are packed into MR-row / NR-column panels, k-major, so the
+ * micro-kernel keeps an MR x NR tile of C in registers and streams both
+ * panels linearly. K is blocked by KC so a B panel stays in L1 and an A
+ * block in L2. The packing helpers and micro-kernel are plain C with GCC
+ * vector extensions (no immintrin.h in kernel space); with -mavx2 -mfma
+ * each tile row is two 8-wide FMAs per k.
+ *
+ * Everything in this header is free of kernel dependencies so it can be
+ * checked in userspace (see test/test_gemm.c). ggml_gemm.c adds the
+ * buffers and FPU regions around the blocking drivers.
+ */
+
+#ifndef _LLAMUX_GGML_GEMM_H
+#define _LLAMUX_GGML_GEMM_H
+
+/* Register tile: 6 rows x 16 columns = 12 accumulators on AVX2 */
+#define GGML_GEMM_MR 6
+#define GGML_GEMM_NR 16
+
+/* Cache blocking */
+#define GGML_GEMM_KC 256    /* B panel KC x NR = 16 KB -> L1 */
+#define GGML_GEMM_MC 72     /* A block MC x KC = 72 KB -> L2, multiple of MR */
+#define GGML_GEMM_NC 1024   /* B block KC x NC = 1 MB -> L2/L3, multiple of NR */
+
+typedef float ggml_v8sf __attribute__((vector_size(32)));
+
+/* Pack mc rows x kc of A into MR-row panels, k-major, zero padded */
+static inline void ggml_gemm_pack_a(const float *A, int lda, int mc, int kc,
+                                    float *Ap) {
+    for (int i = 0; i < mc; i += GGML_GEMM_MR) {
+        const int rows = mc - i < GGML_GEMM_MR ? mc - i : GGML_GEMM_MR;
+
+        for (int k = 0; k < kc; k++) {
+            for (int r = 0; r < GGML_GEMM_MR; r++) {
+                *Ap++ = r < rows ? A[(long)(i + r) * lda + k] : 0.0f;
+            }
+        }
+    }
+}
+
+/* Pack nc columns x kc of B into NR-column panels, k-major, zero padded */
+static inline void ggml_gemm_pack_b(const float *B, int ldb, int nc, int kc,
+                                    float *Bp) {
+    for (int j = 0; j < nc; j += GGML_GEMM_NR) {
+        const int cols = nc - j < GGML_GEMM_NR ? nc - j : GGML_GEMM_NR;
+
+        for (int k = 0; k < kc; k++) {
+            for (int c = 0; c < GGML_GEMM_NR; c++) {
+                *Bp++ = c < cols ? B[(long)(j + c) * ldb + k] : 0.0f;
+            }
+        }
+    }
+}
+
+/*
+ * MR x NR micro-kernel over one packed A panel and one packed B panel.
+ * Writes (or accumulates into) the top-left m x n of the tile at C.
+ */
+static inline void ggml_gemm_micro(int kc, const float *Ap, const float *Bp,
+                                   float *C, int ldc, int m, int n,
+                                   int accumulate) {
+    ggml_v8sf acc[GGML_GEMM_MR][2];
+
+    for (int r = 0; r < GGML_GEMM_MR; r++) {
+        acc[r][0] = (ggml_v8sf){ 0 };
+        acc[r][1] = (ggml_v8sf){ 0 };
+    }
+
+    for (int k = 0; k < kc; k++) {
+        const ggml_v8sf b0 = *(const ggml_v8sf *)(Bp + k * GGML_GEMM_NR);
+        const ggml_v8sf b1 = *(const ggml_v8sf *)(Bp + k * GGML_GEMM_NR + 8);
+        const float *a = Ap + k * GGML_GEMM_MR;
+
+        for (int r = 0; r < GGML_GEMM_MR; r++) {
+            acc[r][0] += a[r] * b0;
+            acc[r][1] += a[r] * b1;
+        }
+    }
+
+    for (int r = 0; r < m; r++) {
+        float *c = C + (long)r * ldc;
+
+        for (int j = 0; j < n; j++) {
+            const float v = acc[r][j >> 3][j & 7];
+            c[j] = accumulate ? c[j] + v : v;
+        }
+    }
+}
+
+/*
+ * One MC x NC x KC block: A and B already packed, C at the block origin.
+ * Packed buffers must be 32-byte aligned.
+ */
+static inline void ggml_gemm_block(int mc, int nc, int kc,
+                                   const float *Ap, const float *Bp,
+                                   float *C, int ldc, int accumulate) {
+    for (int j = 0; j < nc; j += GGML_GEMM_NR) {
+        const int n = nc - j < GGML_GEMM_NR ? nc - j : GGML_GEMM_NR;
+        const float *bp = Bp + (long)(j / GGML_GEMM_NR) * kc * GGML_GEMM_NR;
+
+        for (int i = 0; i < mc; i += GGML_GEMM_MR) {
+            const int m = mc - i < GGML_GEMM_MR ? mc - i : GGML_GEMM_MR;
+            const float *ap = Ap + (long)(i / GGML_GEMM_MR) * kc * GGML_GEMM_MR;
+
+            ggml_gemm_micro(kc, ap, bp, C + (long)i * ldc + j, ldc, m, n,
+                            accumulate);
+        }
+    }
+}
+
+/*
+ * Quantized A for ggml_gemm_q_blocked(): rows of row_bytes, each a run of
+ * whole quant blocks. GGML_GEMM_KC must be a multiple of the block size,
+ * so the KC slice at column pc starts (pc / KC) * kc_bytes into a row.
+ */
+struct ggml_gemm_qa {
+    const void *data;
+    size_t row_bytes;
+    size_t kc_bytes;    /* Bytes holding GGML_GEMM_KC elements */
+    void (*dequant)(const struct ggml_gemm_qa *qa, const void *x, float *y, int k);
+    int type;           /* Quant type, for dequant */
+};
+
+/*
+ * C[i][j] = sum_k A[i][k] * B[j][k] with A quantized, in GotoBLAS order:
+ * each KC x NC slice of B is packed once and stays cache resident while
+ * A is walked in MC-row tiles, dequantizing only the KC columns the slice
+ * needs. A weight is dequantized once per NC activation columns, so once
+ * for any prompt up to NC tokens. panel and Ap hold MC x KC floats, Bp
+ * KC x NC, all 32-byte aligned; yield (may be NULL) runs between blocks.
+ */
+static inline void ggml_gemm_q_blocked(const struct ggml_gemm_qa *qa,
+                                       int M, int N, int K,
+                                       const float *B, int ldb,
+                                       float *C, int ldc,
+                                       float *panel, float *Ap, float *Bp,
+                                       void (*yield)(void *), void *arg) {
+    for (int jc = 0; jc < N; jc += GGML_GEMM_NC) {
+        const int nc = N - jc < GGML_GEMM_NC ? N - jc : GGML_GEMM_NC;
+
+        for (int pc = 0; pc < K; pc += GGML_GEMM_KC) {
+            const int kc = K - pc < GGML_GEMM_KC ? K - pc : GGML_GEMM_KC;
+            const size_t off = (size_t)(pc / GGML_GEMM_KC) * qa->kc_bytes;
+
+            ggml_gemm_pack_b(B + (long)jc * ldb + pc, ldb, nc, kc, Bp);
+
+            for (int ic = 0; ic < M; ic += GGML_GEMM_MC) {
+                const int mc = M - ic < GGML_GEMM_MC ? M - ic : GGML_GEMM_MC;
+
+                for (int r = 0; r < mc; r++) {
+                    qa->dequant(qa, (const char *)qa->data +
+                                    (size_t)(ic + r) * qa->row_bytes + off,
+                                panel + (long)r * kc, kc);
+                }
+                ggml_gemm_pack_a(panel, kc, mc, kc, Ap);
+                ggml_gemm_block(mc, nc, kc, Ap, Bp,
+                                C + (long)ic * ldc + jc, ldc, pc > 0);
+                if (yield)
+                    yield(arg);
+            }
+        }
+    }
+}
+
+#ifdef __KERNEL__
+#include "gguf_parser.h"
+
+/* Driver (ggml_gemm.c) - handles blocking, buffers and FPU regions */
+bool ggml_gemm_wanted(long n_cols);
+void ggml_gemm_f32(int M, int N, int K,
+                   const float *A, int lda,
+                   const float *B, int ldb,
+                   float *C, int ldc);
+
+/* Same product with A stored as quantized rows of row_bytes each */
+int ggml_gemm_q_f32(int M, int N, int K,
+                    const void *Aq, size_t row_bytes, enum ggml_type type,
+                    const float *B, int ldb,
+                    float *C, int ldc);
+#endif
+
+#endif /* _LLAMUX_GGML_GEMM_H */
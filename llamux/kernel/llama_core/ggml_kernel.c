@@ -14,13 +14,31 @@
 #include <linux/mm.h>
 #include <linux/workqueue.h>
 #include <linux/delay.h>
+#include <linux/bitmap.h>
+#include <linux/moduleparam.h>
 #include <asm/fpu/api.h>
+#include <asm/processor.h>
 #include "ggml_kernel.h"
 #include "weight_cache.h"
 #include "quantize.h"
 #include "ggml_simd.h"
 #include "ggml_optimize.h"
 #include "llama_accel.h"
+#include "ggml_gemm.h"
+#include "llama_fpu.h"
+#include "ggml_prof.h"
+
+/* Global weight cache for optimization - read locklessly on every matmul */
+static struct llama_weight_cache *g_weight_cache = NULL;
+
+/* Layer-ahead weight prefetch */
+static int weight_prefetch_layers = 1;
+module_param(weight_prefetch_layers, int, 0644);
+MODULE_PARM_DESC(weight_prefetch_layers, "Layers ahead whose weights are prefetched into the LLC (0=off)");
+
+static uint weight_prefetch_mb = 16;
+module_param(weight_prefetch_mb, uint, 0644);
+MODULE_PARM_DESC(weight_prefetch_mb, "Bytes of each layer's weights to prefetch, in consumption order (MB)");
 
 /* Math functions for kernel space - simple approximations */
 static inline float kernel_expf(float x) {
@@ -52,6 +70,7 @@ static const size_t GGML_TYPE_SIZE[GGML_TYPE_COUNT] = {
     [GGML_TYPE_F32]  = sizeof(float),
     [GGML_TYPE_F16]  = sizeof(uint16_t),
     [GGML_TYPE_Q4_0] = sizeof(uint8_t) + sizeof(uint16_t), /* simplified */
+    [GGML_TYPE_Q8_0] = 34,  /* actual Q8_0 block size */
     [GGML_TYPE_Q4_K] = 144, /* actual Q4_K block size */
 };
 
@@ -97,13 +116,28 @@ size_t ggml_element_size(enum ggml_type type) {
     return GGML_TYPE_SIZE[type];
 }
 
+/* Get size in bytes of one row of ne0 elements (block aware) */
+size_t ggml_row_size(enum ggml_type type, int64_t ne0) {
+    switch (type) {
+    case GGML_TYPE_Q4_0:
+    case GGML_TYPE_Q8_0:
+    case GGML_TYPE_Q4_K:
+    case GGML_TYPE_Q5_K:
+    case GGML_TYPE_Q6_K:
+    case GGML_TYPE_Q8_K:
+        return gguf_tensor_size(type, ne0);
+    default:
+        return ne0 * ggml_element_size(type);
+    }
+}
+
 /* Get tensor size in bytes */
 size_t ggml_nbytes(const struct ggml_tensor *tensor) {
-    size_t nbytes = tensor->ne[0];
+    size_t nbytes = ggml_row_size(tensor->type, tensor->ne[0]);
     for (int i = 1; i < tensor->n_dims; i++) {
         nbytes *= tensor->ne[i];
     }
-    return nbytes * ggml_element_size(tensor->type);
+    return nbytes;
 }
 
 /* Initialize GGML context */
@@ -133,7 +167,9 @@ struct ggml_context *ggml_init(size_t mem_size, void *mem_buffer) {
     /* Only own the buffer if we allocated it ourselves */
     ctx->mem_buffer_owned = allocated_here;
     ctx->mem_used = ALIGN(sizeof(struct ggml_context), GGML_TENSOR_ALIGN);
+    ctx->mem_peak = ctx->mem_used;
     ctx->n_objects = 0;
+    ctx->cur_layer = -1;
     
     pr_info("🦙 GGML: Initialized context with %zu MB\n", mem_size / (1024*1024));
     
@@ -149,6 +185,24 @@ void ggml_free(struct ggml_context *ctx) {
     }
 }
 
+struct ggml_scratch ggml_scratch_mark(struct ggml_context *ctx) {
+    struct ggml_scratch mark = {
+        .mem_used = ctx->mem_used,
+        .n_objects = ctx->n_objects,
+    };
+    
+    return mark;
+}
+
+void ggml_scratch_release(struct ggml_context *ctx, struct ggml_scratch mark) {
+    /* A stale mark would hand persistent tensors out again */
+    if (WARN_ON_ONCE(mark.mem_used > ctx->mem_used || mark.n_objects > ctx->n_objects))
+        return;
+    
+    ctx->mem_used = mark.mem_used;
+    ctx->n_objects = mark.n_objects;
+}
+
 /* Allocate tensor from context */
 struct ggml_tensor *ggml_new_tensor_impl(
     struct ggml_context *ctx,
@@ -172,18 +226,18 @@ struct ggml_tensor *ggml_new_tensor_impl(
         pr_info("🦙 GGML: Node count: %d / %d\n", ctx->n_objects, GGML_MAX_NODES);
     }
     
-    /* Calculate strides */
+    /* Calculate strides - rows of quantized types are whole blocks */
     size_t nb[GGML_MAX_DIMS];
     nb[0] = ggml_element_size(type);
-    size_t ne_total = ne[0];
+    size_t rows_total = 1;
     for (int i = 1; i < n_dims; i++) {
-        nb[i] = nb[i-1] * ne[i-1];
-        ne_total *= ne[i];
+        nb[i] = (i == 1) ? ggml_row_size(type, ne[0]) : nb[i-1] * ne[i-1];
+        rows_total *= ne[i];
     }
     
     /* Calculate sizes */
     tensor_size = ALIGN(sizeof(struct ggml_tensor), GGML_TENSOR_ALIGN);
-    data_size = ne_total * ggml_element_size(type);
+    data_size = rows_total * ggml_row_size(type, ne[0]);
     
     /* Check if we have enough memory */
     if (ctx->mem_used + tensor_size + data_size > ctx->mem_size) {
@@ -220,11 +274,14 @@ struct ggml_tensor *ggml_new_tensor_impl(
     }
     
     tensor->size = data_size;
+    tensor->layer = ctx->cur_layer;
     tensor->op = GGML_OP_NONE;
     tensor->is_param = 0;
+    tensor->stream_dst = false;
     
     /* Add to context */
     ctx->objects[ctx->n_objects++] = tensor;
+    ctx->mem_peak = max(ctx->mem_peak, ctx->mem_used);
     
     return tensor;
 }
@@ -289,10 +346,16 @@ static void ggml_compute_forward_mul_mat_f32_f32(
     const float *b = (float *)src1->data;
     float *c = (float *)dst->data;
     
-    /* Simple matrix multiplication: C = A * B^T */
-    /* This is not optimized - real implementation would use SIMD */
+    /* Prompt batches: packed register-blocked GEMM */
+    if (ggml_gemm_wanted(ne11)) {
+        ggml_gemm_f32(ne01, ne11, ne00, a, ne00, b, ne10, c, ne11);
+        return;
+    }
     
-    kernel_fpu_begin();
+    /* Single token: C = A * B^T as plain dot products */
+    struct llama_fpu_region fpu = { 0 };
+    
+    llama_fpu_begin(&fpu);
     
     for (int64_t i = 0; i < ne01; i++) {
         const float *a_row = a + i * ne00;
@@ -301,9 +364,10 @@ static void ggml_compute_forward_mul_mat_f32_f32(
             const float *b_row = b + j * ne10;
             c[i * ne11 + j] = ggml_vec_dot_f32(a_row, b_row, ne00);
         }
+        llama_fpu_checkpoint(&fpu);
     }
     
-    kernel_fpu_end();
+    llama_fpu_end(&fpu);
 }
 
 /* RMS normalization */
@@ -317,8 +381,9 @@ static void ggml_compute_forward_rms_norm_f32(
     
     const float *x = (float *)src0->data;
     float *y = (float *)dst->data;
+    struct llama_fpu_region fpu = { 0 };
     
-    kernel_fpu_begin();
+    llama_fpu_begin(&fpu);
     
     for (int64_t i = 0; i < ne01; i++) {
         const float *row = x + i * ne00;
@@ -343,9 +408,10 @@ static void ggml_compute_forward_rms_norm_f32(
         for (int64_t j = 0; j < ne00; j++) {
             out[j] = row[j] * rms;
         }
+        llama_fpu_checkpoint(&fpu);
     }
     
-    kernel_fpu_end();
+    llama_fpu_end(&fpu);
 }
 
 /* SiLU activation (x * sigmoid(x)) */
@@ -479,6 +545,8 @@ struct ggml_tensor *ggml_rms_norm(
 /* Export symbols for kernel module linking */
 EXPORT_SYMBOL_GPL(ggml_init);
 EXPORT_SYMBOL_GPL(ggml_free);
+EXPORT_SYMBOL_GPL(ggml_scratch_mark);
+EXPORT_SYMBOL_GPL(ggml_scratch_release);
 EXPORT_SYMBOL_GPL(ggml_new_tensor);
 EXPORT_SYMBOL_GPL(ggml_new_tensor_1d);
 EXPORT_SYMBOL_GPL(ggml_new_tensor_2d);
@@ -721,6 +789,10 @@ void ggml_compute_forward(struct ggml_tensor *tensor) {
             } else if (tensor->src0->type == GGML_TYPE_Q4_K && tensor->src1->type == GGML_TYPE_F32) {
                 /* For Q4_K, use Q4_0 as approximation for now */
                 ggml_compute_forward_mul_mat_q4_0_f32(tensor->src0, tensor->src1, tensor);
+            } else if ((tensor->src0->type == GGML_TYPE_Q8_0 || tensor->src0->type == GGML_TYPE_F16) &&
+                       tensor->src1->type == GGML_TYPE_F32) {
+                /* Requantized / half weights go through the dequantizing path */
+                ggml_compute_forward_mul_mat_q4_0_f32(tensor->src0, tensor->src1, tensor);
             }
             break;
             
@@ -811,68 +883,61 @@ void ggml_compute_forward(struct ggml_tensor *tensor) {
                 const int64_t n = tensor->src1->ne[0];
                 
                 if (tensor->src0->type == GGML_TYPE_F32) {
-                    /* Float embeddings - direct copy */
+                    /* Float embeddings - direct copy, no FPU needed */
                     const float *src = (float *)tensor->src0->data;
-                    kernel_fpu_begin();
                     for (int64_t i = 0; i < n; i++) {
                         int32_t idx = indices[i];
                         if (idx >= 0 && idx < tensor->src0->ne[1]) {
                             memcpy(dst + i * ne0, src + idx * ne0, ne0 * sizeof(float));
                         }
                     }
-                    kernel_fpu_end();
-                } else if (tensor->src0->type == GGML_TYPE_Q4_K) {
-                    /* Quantized embeddings - need to dequantize */
-                    pr_info("🦙 GGML: Dequantizing embeddings for %lld tokens, src data=%p\n", n, tensor->src0->data);
+                } else {
+                    /* Quantized embeddings - hot rows come from the cache, the rest are decoded */
+                    struct llama_weight_cache *cache = READ_ONCE(g_weight_cache);
+                    const size_t row_size = gguf_tensor_size(tensor->src0->type, ne0);
+                    unsigned long *decoded;
+                    int64_t n_decoded = 0;
+                    
+                    pr_debug("🦙 GGML: GET_ROWS for %lld tokens, src data=%p\n", n, tensor->src0->data);
                     
-                    /* Debug: print token indices */
-                    pr_info("🦙 GGML: Token indices:");
-                    for (int64_t j = 0; j < min(n, 10); j++) {
-                        pr_cont(" %d", indices[j]);
+                    if (!row_size) {
+                        pr_err("🦙 GGML: Unsupported embedding type %d in GET_ROWS\n", tensor->src0->type);
+                        break;
                     }
-                    pr_cont("\n");
                     
+                    decoded = bitmap_zalloc(n, GFP_KERNEL);
+                    
+                    struct llama_fpu_region fpu = { 0 };
                     for (int64_t i = 0; i < n; i++) {
                         int32_t idx = indices[i];
-                        if (idx >= 0 && idx < tensor->src0->ne[1]) {
-                            /* Calculate offset in quantized data */
-                            /* For embeddings, ne0 is embedding dim, and we need the size of one embedding */
-                            size_t row_size;
-                            if (tensor->src0->type == GGML_TYPE_Q4_K) {
-                                /* Q4_K: each row has ne0/256 blocks of 144 bytes each */
-                                row_size = (ne0 / 256) * 144;
-                            } else {
-                                row_size = gguf_tensor_size(tensor->src0->type, ne0);
-                            }
-                            const void *src_row = (uint8_t *)tensor->src0->data + idx * row_size;
-                            
-                            /* Debug first token */
-                            if (i == 0) {
-                                uint8_t *data = (uint8_t *)src_row;
-                                pr_info("🦙 GGML: GET_ROWS: ne0=%lld, row_size=%zu, idx=%d, offset=%zu\n",
-                                        ne0, row_size, idx, idx * row_size);
-                                pr_info("🦙 GGML: src0->data=%p, src_row=%p\n", 
-                                        tensor->src0->data, src_row);
-                                pr_info("🦙 GGML: Token %lld (idx=%d) first 16 bytes: %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x\n",
-                                        i, idx, data[0], data[1], data[2], data[3], data[4], data[5], data[6], data[7],
-                                        data[8], data[9], data[10], data[11], data[12], data[13], data[14], data[15]);
-                            }
-                            
-                            /* Dequantize this row */
-                            dequantize_row(src_row, dst + i * ne0, ne0, tensor->src0->type);
-                            
-                            /* Debug: check if dequantized values are non-zero */
-                            if (i == 0) {
-                                float *row_data = dst + i * ne0;
-                                kernel_fpu_begin();
-                                pr_info("🦙 GGML: First 5 embedding values after dequant: %.3f %.3f %.3f %.3f %.3f\n",
-                                        row_data[0], row_data[1], row_data[2], row_data[3], row_data[4]);
-                                kernel_fpu_end();
-                            }
-                        }
+                        if (idx < 0 || idx >= tensor->src0->ne[1])
+                            continue;
+                        
+                        /* Cached rows are plain F32 - copied without the FPU */
+                        if (cache && llama_weight_cache_copy_row(cache, tensor->src0, idx, dst + i * ne0))
+                            continue;
+                        
+                        const void *src_row = (uint8_t *)tensor->src0->data + idx * row_size;
+                        
+                        llama_fpu_begin(&fpu);
+                        dequantize_row(src_row, dst + i * ne0, ne0, tensor->src0->type);
+                        llama_fpu_checkpoint(&fpu);
+                        if (decoded)
+                            __set_bit(i, decoded);
+                        n_decoded++;
                     }
-                } else {
-                    pr_err("🦙 GGML: Unsupported embedding type %d in GET_ROWS\n", tensor->src0->type);
+                    llama_fpu_end(&fpu);
+                    
+                    /* Keep what we decoded for the next prompt */
+                    if (cache && decoded) {
+                        unsigned long i;
+                        
+                        for_each_set_bit(i, decoded, n)
+                            llama_weight_cache_store_row(cache, tensor->src0, indices[i], dst + i * ne0);
+                    }
+                    bitmap_free(decoded);
+                    
+                    pr_debug("🦙 GGML: GET_ROWS decoded %lld of %lld rows\n", n_decoded, n);
                 }
             }
             break;
@@ -887,7 +952,63 @@ void ggml_compute_forward(struct ggml_tensor *tensor) {
 }
 
 /* Execute computation graph */
+/*
+ * Layer-ahead prefetch. When a matmul of layer L starts, the weights of
+ * layers up to L + weight_prefetch_layers are streamed into the LLC by
+ * a spare compute thread in the order the graph will read them. Only the
+ * first weight_prefetch_mb of each layer is pulled in: a whole layer is
+ * larger than the LLC and would evict itself before it is used.
+ */
+static void ggml_prefetch_weights(struct ggml_cgraph *gf, int node_idx, int *prefetched) {
+    const int dist = READ_ONCE(weight_prefetch_layers);
+    const size_t layer_budget = (size_t)READ_ONCE(weight_prefetch_mb) << 20;
+    struct llama_weight_cache *cache = READ_ONCE(g_weight_cache);
+    int layer, target, from, cur = -1;
+    size_t budget = 0;
+    
+    if (dist <= 0 || !layer_budget)
+        return;
+    
+    layer = llama_weight_cache_layer(gf->nodes[node_idx]->src0);
+    target = layer + dist;
+    if (layer < 0 || target <= *prefetched)
+        return;
+    from = max(*prefetched, layer);
+    *prefetched = target;
+    
+    for (int j = node_idx + 1; j < gf->n_nodes; j++) {
+        struct ggml_tensor *node = gf->nodes[j];
+        const void *addr;
+        size_t size;
+        int l;
+        
+        if (!node || node->op != GGML_OP_MUL_MAT)
+            continue;
+        l = llama_weight_cache_layer(node->src0);
+        if (l <= from)
+            continue;
+        if (l > target)
+            break;
+        
+        if (l != cur) {
+            cur = l;
+            budget = layer_budget;
+        }
+        if (!budget)
+            continue;
+        
+        addr = llama_weight_cache_peek(cache, node->src0, &size);
+        size = min(size, budget);
+        if (!addr || llama_accel_prefetch(addr, size))
+            return;
+        budget -= size;
+    }
+}
+
 void ggml_graph_compute(struct ggml_context *ctx, struct ggml_cgraph *gf) {
+    int prefetched = -1;        /* Last layer whose weights were prefetched */
+    u64 prof_start;
+    
     if (!ctx || !gf) return;
     
     pr_info("🦙 GGML: Computing graph with %d nodes\n", gf->n_nodes);
@@ -939,8 +1060,13 @@ void ggml_graph_compute(struct ggml_context *ctx, struct ggml_cgraph *gf) {
                 memset(node->data, 0, size);
             }
             
+            if (node->op == GGML_OP_MUL_MAT)
+                ggml_prefetch_weights(gf, i, &prefetched);
+            
             /* Compute this node */
+            prof_start = ggml_prof_start();
             ggml_compute_forward(node);
+            ggml_prof_record(node, prof_start);
             
             /* Debug: check output of key operations */
             if (node->op == GGML_OP_GET_ROWS && node->data) {
@@ -961,10 +1087,6 @@ void ggml_graph_compute(struct ggml_context *ctx, struct ggml_cgraph *gf) {
             ctx->mem_used / (1024*1024), ctx->mem_size / (1024*1024));
 }
 
-/* Global weight cache for optimization */
-static struct llama_weight_cache *g_weight_cache = NULL;
-static DEFINE_MUTEX(g_cache_mutex);
-
 /* Parallel processing support */
 #include <linux/workqueue.h>
 #include <linux/percpu.h>
@@ -985,9 +1107,7 @@ static struct workqueue_struct *ggml_wq = NULL;
 
 /* Set global weight cache */
 void ggml_set_weight_cache(struct llama_weight_cache *cache) {
-    mutex_lock(&g_cache_mutex);
-    g_weight_cache = cache;
-    mutex_unlock(&g_cache_mutex);
+    WRITE_ONCE(g_weight_cache, cache);
 }
 
 /* Export new symbols */
@@ -997,48 +1117,128 @@ EXPORT_SYMBOL_GPL(ggml_compute_forward);
 EXPORT_SYMBOL_GPL(ggml_set_weight_cache);
 
 
-/* Quantized matrix multiplication stub */
-/* Forward declaration of fast implementation */
-void ggml_compute_forward_mul_mat_q4k_fast(
-    const struct ggml_tensor *src0,
-    const struct ggml_tensor *src1,
-    struct ggml_tensor *dst);
+/* GEMV memory hints - -1 picks a value for the CPU family */
+static int gemv_prefetch_bytes = -1;
+module_param(gemv_prefetch_bytes, int, 0644);
+MODULE_PARM_DESC(gemv_prefetch_bytes, "GEMV weight prefetch distance in bytes (-1=auto by CPU family, 0=off)");
 
-void ggml_compute_forward_mul_mat_q4_0_f32(
-    const struct ggml_tensor *src0,
-    const struct ggml_tensor *src1,
-    struct ggml_tensor *dst) {
+static int gemv_stream_stores = -1;
+module_param(gemv_stream_stores, int, 0644);
+MODULE_PARM_DESC(gemv_stream_stores, "Non-temporal stores for large GEMV outputs (-1=auto by CPU family, 0=off, 1=on)");
+
+static uint gemv_stream_min_kb = 64;
+module_param(gemv_stream_min_kb, uint, 0644);
+MODULE_PARM_DESC(gemv_stream_min_kb, "Smallest GEMV output (KB) written with non-temporal stores");
+
+/*
+ * Zen keeps more L2 misses in flight than the Intel cores, so it wants
+ * a longer distance. Both combine movnti into full-line writes.
+ */
+size_t ggml_gemv_prefetch_distance(void) {
+    const int bytes = READ_ONCE(gemv_prefetch_bytes);
+    
+    if (bytes >= 0)
+        return bytes;
+    
+    switch (boot_cpu_data.x86_vendor) {
+    case X86_VENDOR_AMD:
+    case X86_VENDOR_HYGON:
+        return boot_cpu_data.x86 >= 0x17 ? 2048 : 1024;
+    case X86_VENDOR_INTEL:
+        return 1024;
+    default:
+        return 0;
+    }
+}
+
+bool ggml_gemv_stream_output(const struct ggml_tensor *w, size_t bytes) {
+    const int mode = READ_ONCE(gemv_stream_stores);
+    
+    /* Anything else is read back by the next op while still in cache */
+    if (!w->stream_dst)
+        return false;
+    if (bytes < (size_t)READ_ONCE(gemv_stream_min_kb) * 1024)
+        return false;
+    if (mode >= 0)
+        return mode;
+    
+    return boot_cpu_data.x86_vendor == X86_VENDOR_INTEL ||
+           boot_cpu_data.x86_vendor == X86_VENDOR_AMD ||
+           boot_cpu_data.x86_vendor == X86_VENDOR_HYGON;
+}
+
+/* Rows per parallel_for chunk in the quantized GEMV */
+#define GGML_MUL_MAT_ROW_GRAIN 64
+
+/* A quantized matmul split by weight row */
+struct ggml_mul_mat_rows_ctx {
+    const float *w_f32;         /* Cached F32 weights, or NULL to decode w_data */
+    const void *w_data;
+    enum ggml_type w_type;
+    size_t w_row_bytes;
+    float *row_buf;             /* ne00 floats per worker for decoded rows */
+    const float *src1;
+    float *dst;
+    int64_t ne00, ne10, ne11;
+    size_t prefetch;            /* Bytes ahead of the row stream, 0 = none */
+    bool stream;                /* Write dst with non-temporal stores */
+};
+
+static int ggml_mul_mat_rows(void *data, int worker, long start, long end) {
+    const struct ggml_mul_mat_rows_ctx *c = data;
+    struct llama_fpu_region fpu = { 0 };
+    float *row_buf = c->row_buf ? c->row_buf + (size_t)worker * c->ne00 : NULL;
     
-    /* Try to use acceleration engine if available */
-    extern struct llama_accel_engine *llama_accel;
-    if (llama_accel && llama_accel->initialized && src0->type == GGML_TYPE_Q4_K) {
-        pr_info("🦙 GGML: Using acceleration for %lldx%lld Q4_K matmul\n", 
-                src0->ne[1], src1->ne[1]);
+    llama_fpu_begin(&fpu);
+    
+    for (long i = start; i < end; i++) {
+        const float *weight_row;
         
-        struct llama_compute_request req = {
-            .op = LLAMA_OP_MATMUL_Q4K,
-            .src0 = src0->data,
-            .src1 = src1->data,
-            .dst = dst->data,
-            .m = src0->ne[1],
-            .n = src1->ne[1],
-            .k = src0->ne[0],
-        };
+        llama_fpu_checkpoint(&fpu);
         
-        /* For now, do synchronous compute */
-        kernel_fpu_begin();
-        llama_accel_matmul_q4k(req.src0, req.src1, req.dst, req.m, req.n, req.k);
-        kernel_fpu_end();
-        return;
+        /* Rows are contiguous: keep one row's worth in flight 'prefetch' bytes ahead */
+        if (c->prefetch) {
+            const size_t row_bytes = c->w_f32 ? c->ne00 * sizeof(float) : c->w_row_bytes;
+            const char *row = c->w_f32 ? (const char *)(c->w_f32 + i * c->ne00) :
+                                         (const char *)c->w_data + i * c->w_row_bytes;
+            
+            ggml_prefetch_range(row + c->prefetch, row_bytes);
+        }
+        
+        if (c->w_f32) {
+            weight_row = c->w_f32 + i * c->ne00;
+        } else {
+            dequantize_row((const char *)c->w_data + i * c->w_row_bytes,
+                           row_buf, c->ne00, c->w_type);
+            weight_row = row_buf;
+        }
+        
+        for (int64_t j = 0; j < c->ne11; j++) {
+            /* Use optimized SIMD dot product */
+            float v = ggml_vec_dot_f32(weight_row, c->src1 + j * c->ne10, c->ne00);
+            
+            if (c->stream)
+                ggml_store_stream_f32(&c->dst[i * c->ne11 + j], v);
+            else
+                c->dst[i * c->ne11 + j] = v;
+        }
     }
     
-    /* Use fast path for Q4_K - disabled for now */
-    if (0 && src0->type == GGML_TYPE_Q4_K) {
-        extern void ggml_compute_forward_mul_mat_q4k_fast(
-            const struct ggml_tensor *src0,
-            const struct ggml_tensor *src1,
-            struct ggml_tensor *dst);
-        ggml_compute_forward_mul_mat_q4k_fast(src0, src1, dst);
+    if (c->stream)
+        ggml_stream_fence();
+    llama_fpu_end(&fpu);
+    return 0;
+}
+
+/* Quantized matrix multiplication */
+void ggml_compute_forward_mul_mat_q4_0_f32(
+    const struct ggml_tensor *src0,
+    const struct ggml_tensor *src1,
+    struct ggml_tensor *dst) {
+    
+    /* Integer Q4_K path - no FPU save/restore in the inner loop */
+    if (ggml_q4k_int_wanted(src0, src1)) {
+        ggml_compute_forward_mul_mat_q4k_int(src0, src1, dst);
         return;
     }
     
@@ -1048,114 +1248,79 @@ void ggml_compute_forward_mul_mat_q4_0_f32(
     const int64_t ne10 = src1->ne[0];
     const int64_t ne11 = src1->ne[1];
     
-    /* Check if we have a global weight cache and this is a weight tensor */
-    float *cached_weights = NULL;
+    /* Weight tensors are tagged with their cache slot at model load */
+    struct llama_weight_cache *cache = READ_ONCE(g_weight_cache);
+    struct weight_cache_ref cache_ref;
+    const float *cached_weights = NULL;
     bool use_cache = false;
     
-    mutex_lock(&g_cache_mutex);
-    if (g_weight_cache && src0->op == GGML_OP_NONE && src0->type != GGML_TYPE_F32) {
-        /* This looks like a weight tensor - check if it has a name */
-        static int debug_count = 0;
-        if (debug_count++ < 10) {
-            pr_info("🦙 GGML: Weight tensor check - name: '%s', type: %d\n", 
-                    src0->name[0] ? src0->name : "(empty)", src0->type);
-        }
-        if (src0->name[0] != '\0') {
-            /* Parse layer and type from name like "blk.0.attn_q.weight" */
-            int layer = 0;
-            enum weight_type type = WEIGHT_WQ;
-            
-            if (sscanf(src0->name, "blk.%d.", &layer) == 1) {
-                /* Determine weight type from name */
-                if (strstr(src0->name, "attn_q")) type = WEIGHT_WQ;
-                else if (strstr(src0->name, "attn_k")) type = WEIGHT_WK;
-                else if (strstr(src0->name, "attn_v")) type = WEIGHT_WV;
-                else if (strstr(src0->name, "attn_output")) type = WEIGHT_WO;
-                else if (strstr(src0->name, "ffn_gate")) type = WEIGHT_W1;
-                else if (strstr(src0->name, "ffn_down")) type = WEIGHT_W2;
-                else if (strstr(src0->name, "ffn_up")) type = WEIGHT_W3;
-                
-                cached_weights = llama_weight_cache_get(g_weight_cache, 
-                                                       layer, type,
-                                                       src0->data, ne00 * ne01, src0->type);
-                if (cached_weights) {
-                    use_cache = true;
-                    pr_info("🦙 GGML: Using cached weights for %s\n", src0->name);
-                }
-            }
+    /* Where the rows come from - the cache may hold them in F16 or Q8_0 */
+    const void *w_data = src0->data;
+    enum ggml_type w_type = src0->type;
+    size_t w_row_bytes = src0->nb[1];
+    
+    if (cache && src0->cache_slot && src0->type != GGML_TYPE_F32 &&
+        llama_weight_cache_get_tensor(cache, src0, &cache_ref)) {
+        use_cache = true;
+        if (cache_ref.type == GGML_TYPE_F32) {
+            cached_weights = cache_ref.data;
+        } else {
+            w_data = cache_ref.data;
+            w_type = cache_ref.type;
+            w_row_bytes = cache_ref.row_bytes;
         }
     }
-    mutex_unlock(&g_cache_mutex);
     
-    if (use_cache && cached_weights) {
-        /* Fast path - use pre-dequantized weights */
-        kernel_fpu_begin();
-        
-        for (int64_t i = 0; i < ne01; i++) {
-            if (i > 0 && (i % 256) == 0) {
-                kernel_fpu_end();
-                if (need_resched()) {
-                    cond_resched();
-                }
-                kernel_fpu_begin();
-            }
-            
-            const float *weight_row = cached_weights + i * ne00;
-            
-            for (int64_t j = 0; j < ne11; j++) {
-                float sum = 0.0f;
-                const float *src1_col = (float *)src1->data + j * ne10;
-                
-                /* Use optimized SIMD dot product */
-                sum = ggml_vec_dot_f32(weight_row, src1_col, ne00);
-                
-                float *dst_ptr = (float *)dst->data + i * ne11 + j;
-                *dst_ptr = sum;
-            }
-        }
-        
-        kernel_fpu_end();
+    if (cached_weights && ggml_gemm_wanted(ne11)) {
+        /* Prompt batch over pre-dequantized weights - blocked GEMM */
+        ggml_gemm_f32(ne01, ne11, ne00, cached_weights, ne00,
+                      (const float *)src1->data, ne10,
+                      (float *)dst->data, ne11);
+    } else if (ggml_gemm_wanted(ne11) &&
+               ggml_gemm_q_f32(ne01, ne11, ne00, w_data, w_row_bytes, w_type,
+                               (const float *)src1->data, ne10,
+                               (float *)dst->data, ne11) == 0) {
+        /* Prompt batch - each weight dequantized once per NC columns */
     } else {
-        /* Slow path - dequantize on the fly */
-        float *row_buf = kvmalloc(ne00 * sizeof(float), GFP_KERNEL);
-        if (!row_buf) {
-            pr_err("🦙 GGML: Failed to allocate dequant buffer\n");
-            return;
-        }
-        
-        kernel_fpu_begin();
+        /* Decode - weight rows split across the compute threads */
+        int workers = llama_accel_parallel_workers();
+        struct ggml_mul_mat_rows_ctx rows = {
+            .w_f32 = cached_weights,
+            .w_data = w_data,
+            .w_type = w_type,
+            .w_row_bytes = w_row_bytes,
+            .src1 = (const float *)src1->data,
+            .dst = (float *)dst->data,
+            .ne00 = ne00,
+            .ne10 = ne10,
+            .ne11 = ne11,
+            .prefetch = ggml_gemv_prefetch_distance(),
+            .stream = ggml_gemv_stream_output(src0, ne01 * ne11 * sizeof(float)),
+        };
+        int ret = 0;
         
-        for (int64_t i = 0; i < ne01; i++) {
-            if (i > 0 && (i % 128) == 0) {
-                kernel_fpu_end();
-                if (need_resched()) {
-                    cond_resched();
-                }
-                kernel_fpu_begin();
-            }
-            
-            if (ne01 > 100 && i > 0 && (i % 100) == 0) {
-                pr_info("🦙 GGML: MulMat progress: %lld/%lld rows (%.1f%%)\n", 
-                        i, ne01, (float)i * 100.0f / ne01);
-            }
-            
-            const void *row_quant = (char *)src0->data + i * src0->nb[1];
-            dequantize_row(row_quant, row_buf, ne00, src0->type);
-            
-            for (int64_t j = 0; j < ne11; j++) {
-                float sum = 0.0f;
-                const float *src1_col = (float *)src1->data + j * ne10;
-                
-                /* Use optimized SIMD dot product */
-                sum = ggml_vec_dot_f32(row_buf, src1_col, ne00);
-                
-                float *dst_ptr = (float *)dst->data + i * ne11 + j;
-                *dst_ptr = sum;
+        /* One decode buffer per worker, allocated once for the whole matmul */
+        if (!cached_weights) {
+            rows.row_buf = kvmalloc_array(workers, ne00 * sizeof(float), GFP_KERNEL);
+            if (!rows.row_buf && workers > 1) {
+                /* Short on memory - decode every row here with one buffer */
+                workers = 1;
+                rows.row_buf = kvmalloc_array(1, ne00 * sizeof(float), GFP_KERNEL);
             }
+            if (!rows.row_buf)
+                ret = -ENOMEM;
         }
-        
-        kernel_fpu_end();
-        kvfree(row_buf);
+        if (!ret)
+            ret = llama_accel_parallel_for(ne01, GGML_MUL_MAT_ROW_GRAIN, workers,
+                                           ggml_mul_mat_rows, &rows);
+        kvfree(rows.row_buf);
+        if (ret < 0)
+            pr_err("🦙 GGML: MulMat %lldx%lld failed: %d\n", ne01, ne11, ret);
+    }
+    
+    /* Drop our reference so the entry can be evicted again */
+    if (use_cache) {
+        llama_weight_cache_put(cache, &cache_ref);
     }
 }
 
@@ -73,6 +73,15 @@ struct ggml_tensor {
     
     /* Extra data for operations */
     void *extra;
+    
+    /* Weight cache slot, resolved once at model load (0 = not cached) */
+    int cache_slot;
+    
+    /* Weight whose matmul output is read once, far away (the logits) */
+    bool stream_dst;
+    
+    /* Transformer layer the node was built for, -1 outside the layers */
+    int layer;
 };
 
 /* Context for memory allocation */
@@ -86,6 +95,19 @@ struct ggml_context {
     
     /* Simple bump allocator */
     size_t mem_used;
+    size_t mem_peak;            /* High-water mark of mem_used */
+    
+    int    cur_layer;           /* Stamped on new tensors, see ggml_set_layer() */
+};
+
+/*
+ * Scratch checkpoint. Everything below the first mark is the persistent
+ * arena (weights, KV cache, model tensors); tensors created after a
+ * mark are scratch and ggml_scratch_release() drops them all at once.
+ */
+struct ggml_scratch {
+    size_t mem_used;
+    int n_objects;
 };
 
 /* Computation plan */
@@ -102,6 +124,15 @@ struct ggml_cgraph {
 struct ggml_context *ggml_init(size_t mem_size, void *mem_buffer);
 void ggml_free(struct ggml_context *ctx);
 
+/* Tensors created from now on belong to layer (-1 = none), for profiling */
+static inline void ggml_set_layer(struct ggml_context *ctx, int layer) {
+    ctx->cur_layer = layer;
+}
+
+/* Scratch checkpoints - marks nest, release the innermost first */
+struct ggml_scratch ggml_scratch_mark(struct ggml_context *ctx);
+void ggml_scratch_release(struct ggml_context *ctx, struct ggml_scratch mark);
+
 /* Tensor creation */
 struct ggml_tensor *ggml_new_tensor(struct ggml_context *ctx,
                                    enum ggml_type type,
@@ -196,6 +227,7 @@ void ggml_graph_compute(struct ggml_context *ctx, struct ggml_cgraph *gf);
 size_t ggml_element_size(enum ggml_type type);
 size_t ggml_tensor_overhead(void);
 size_t ggml_nbytes(const struct ggml_tensor *tensor);
+size_t ggml_row_size(enum ggml_type type, int64_t ne0);
 void   ggml_set_name(struct ggml_tensor *tensor, const char *name);
 
 /* Quantization functions */
@@ -204,6 +236,23 @@ void ggml_compute_forward_mul_mat_q4_0_f32(
     const struct ggml_tensor *src1,
     struct ggml_tensor *dst);
 
+/*
+ * GEMV memory hints, chosen per CPU family unless set by module
+ * parameter: how far ahead of the weight stream to prefetch (bytes,
+ * 0 = off), and whether the output of weight w, this large, is written
+ * with non-temporal stores. Only weights marked stream_dst qualify.
+ */
+size_t ggml_gemv_prefetch_distance(void);
+bool ggml_gemv_stream_output(const struct ggml_tensor *w, size_t bytes);
+
+/* Integer-only Q4_K x Q8_K path (ggml_kernel_fast.c) */
+bool ggml_q4k_int_wanted(const struct ggml_tensor *src0,
+                         const struct ggml_tensor *src1);
+void ggml_compute_forward_mul_mat_q4k_int(
+    const struct ggml_tensor *src0,
+    const struct ggml_tensor *src1,
+    struct ggml_tensor *dst);
+
 /* Debug */
 void ggml_print_tensor_info(const struct ggml_tensor *t);
 
@@ -1,149 +1,134 @@
 /*
  * Fast kernel-space matrix multiplication for Q4_K quantized models
  * Uses integer-only operations to avoid FPU overhead
+ *
+ * Activations are quantized to Q8_K once per matmul (one FPU region),
+ * the Q4_K x Q8_K dot products run entirely in integer registers with
+ * preemption enabled, and each tile of output rows is folded back to
+ * float in a single short FPU region.
  */
 
 #include <linux/kernel.h>
+#include <linux/module.h>
 #include <linux/slab.h>
+#include <linux/mm.h>
 #include <linux/sched.h>
-#include <asm/fpu/api.h>
 #include "ggml_kernel.h"
+#include "ggml_simd.h"
 #include "quantize.h"
+#include "llama_fpu.h"
 
-/* Define min if not already defined */
-#ifndef min
-#define min(a,b) ((a) < (b) ? (a) : (b))
-#endif
+/* Integer path policy: 0 = off, 1 = auto (small matrices), 2 = always */
+static int q4k_int_matmul = 1;
+module_param(q4k_int_matmul, int, 0644);
+MODULE_PARM_DESC(q4k_int_matmul, "Integer Q4_K matmul: 0=off, 1=auto, 2=always");
 
-/* Fast integer-only Q4_K dot product */
-static int32_t dot_product_q4k_int32(
-    const struct block_q4_K *x, 
-    const float *y,
-    int nb
-) {
-    int64_t sum = 0;
-    
-    for (int i = 0; i < nb; i++) {
-        const struct block_q4_K *block = &x[i];
-        const float *yb = y + i * QK_K;
-        
-        /* Convert scales to fixed point (16.16) */
-        int32_t d_fp = (int32_t)(block->d * 65536.0f);
-        int32_t dmin_fp = (int32_t)(block->dmin * 65536.0f);
-        
-        /* Process 32 values at a time */
-        for (int j = 0; j < QK_K/2; j++) {
-            uint8_t byte = block->qs[j];
-            
-            /* Extract two 4-bit values */
-            int32_t v0 = (byte & 0xF) - 8;
-            int32_t v1 = ((byte >> 4) & 0xF) - 8;
-            
-            /* Convert y values to fixed point */
-            int32_t y0 = (int32_t)(yb[j*2] * 256.0f);
-            int32_t y1 = (int32_t)(yb[j*2 + 1] * 256.0f);
-            
-            /* Accumulate using integer math */
-            sum += (v0 * y0 * d_fp) >> 22;  /* 16+8-2 = 22 bits to shift */
-            sum += (v1 * y1 * d_fp) >> 22;
-        }
-    }
-    
-    /* Convert back to float */
-    return sum;
+/* Auto mode uses the integer path for weights up to this many elements */
+static ulong q4k_int_max_elems = 2048UL * 2048UL;
+module_param(q4k_int_max_elems, ulong, 0644);
+MODULE_PARM_DESC(q4k_int_max_elems, "Largest Q4_K weight (elements) for the auto integer path");
+
+/* Budget for the per-tile integer partial sums (kept L2 resident) */
+#define Q4K_INT_TILE_BYTES (64 * 1024)
+
+/* Should this matmul take the integer path? */
+bool ggml_q4k_int_wanted(const struct ggml_tensor *src0,
+                         const struct ggml_tensor *src1) {
+    if (q4k_int_matmul == 0)
+        return false;
+    if (src0->type != GGML_TYPE_Q4_K || src1->type != GGML_TYPE_F32)
+        return false;
+    if (src0->ne[0] % QK_K != 0 || src0->ne[0] != src1->ne[0])
+        return false;
+    if (q4k_int_matmul == 2)
+        return true;
+
+    /* Small matrices: FPU save/restore dominates the float path */
+    return (u64)src0->ne[0] * src0->ne[1] <= q4k_int_max_elems;
 }
 
-/* Optimized matrix multiplication for Q4_K */
-void ggml_compute_forward_mul_mat_q4k_fast(
+/* Integer Q4_K x Q8_K matrix multiplication */
+void ggml_compute_forward_mul_mat_q4k_int(
     const struct ggml_tensor *src0,
-    const struct ggml_tensor *src1, 
+    const struct ggml_tensor *src1,
     struct ggml_tensor *dst
 ) {
-    pr_info("🦙 Fast MatMul: Using optimized Q4_K implementation!\n");
     const int64_t ne00 = src0->ne[0];
     const int64_t ne01 = src0->ne[1];
     const int64_t ne10 = src1->ne[0];
     const int64_t ne11 = src1->ne[1];
-    
+
     const int nb = ne00 / QK_K;
-    
-    /* Process in chunks to allow preemption */
-    const int CHUNK_SIZE = 64;
-    
-    kernel_fpu_begin();
-    
-    for (int64_t i = 0; i < ne01; i++) {
-        const struct block_q4_K *row = (struct block_q4_K *)((char *)src0->data + i * src0->nb[1]);
-        
-        /* Allow preemption every chunk */
-        if (i > 0 && (i % CHUNK_SIZE) == 0) {
-            kernel_fpu_end();
-            if (need_resched()) {
-                cond_resched();
-            }
-            kernel_fpu_begin();
-            
-            /* Progress reporting for large matrices */
-            if (ne01 > 1000 && (i % 1000) == 0) {
-                pr_info("🦙 Fast MatMul: %lld/%lld rows (%.1f%%)\n", 
-                        i, ne01, (float)i * 100.0f / ne01);
-            }
-        }
-        
-        for (int64_t j = 0; j < ne11; j++) {
-            const float *col = (float *)src1->data + j * ne10;
-            
-            /* Use integer-only dot product */
-            int32_t sum_int = dot_product_q4k_int32(row, col, nb);
-            
-            /* Store result as float */
-            float *dst_ptr = (float *)dst->data + i * ne11 + j;
-            *dst_ptr = (float)sum_int / 256.0f;
-        }
+    const size_t ahead = ggml_gemv_prefetch_distance();
+    struct llama_fpu_region fpu = { 0 };
+    struct block_q8_K *y;
+    int32_t *isum, *msum;
+    int64_t tile_rows;
+
+    if (ne00 % QK_K != 0 || ne00 != ne10) {
+        pr_err("🦙 Fast MatMul: Bad shape for Q4_K integer path (%lld, %lld)\n",
+               ne00, ne10);
+        return;
     }
-    
-    kernel_fpu_end();
-}
 
-/* Even faster version using block processing */
-void ggml_compute_forward_mul_mat_q4k_block(
-    const struct ggml_tensor *src0,
-    const struct ggml_tensor *src1,
-    struct ggml_tensor *dst
-) {
-    const int64_t ne00 = src0->ne[0];
-    const int64_t ne01 = src0->ne[1]; 
-    const int64_t ne10 = src1->ne[0];
-    const int64_t ne11 = src1->ne[1];
-    
-    const int nb = ne00 / QK_K;
-    const int BLOCK_SIZE = 16;  /* Process 16x16 blocks */
-    
-    /* Zero output first */
-    memset(dst->data, 0, ne01 * ne11 * sizeof(float));
-    
-    /* Block-wise computation for better cache usage */
-    for (int64_t i0 = 0; i0 < ne01; i0 += BLOCK_SIZE) {
-        for (int64_t j0 = 0; j0 < ne11; j0 += BLOCK_SIZE) {
-            
-            /* Process block */
-            for (int64_t i = i0; i < min(i0 + BLOCK_SIZE, ne01); i++) {
-                const struct block_q4_K *row = (struct block_q4_K *)((char *)src0->data + i * src0->nb[1]);
-                
-                for (int64_t j = j0; j < min(j0 + BLOCK_SIZE, ne11); j++) {
-                    const float *col = (float *)src1->data + j * ne10;
-                    
-                    int32_t sum_int = dot_product_q4k_int32(row, col, nb);
-                    
-                    float *dst_ptr = (float *)dst->data + i * ne11 + j;
-                    *dst_ptr = (float)sum_int / 256.0f;
-                }
+    /* Pick a row tile so the partial sums stay cache resident */
+    tile_rows = Q4K_INT_TILE_BYTES / (ne11 * nb * 2 * sizeof(int32_t));
+    tile_rows = clamp_t(int64_t, tile_rows, 1, ne01);
+
+    y = kvmalloc_array(ne11 * nb, sizeof(*y), GFP_KERNEL);
+    isum = kvmalloc_array(tile_rows * ne11 * nb, sizeof(int32_t), GFP_KERNEL);
+    msum = kvmalloc_array(tile_rows * ne11 * nb, sizeof(int32_t), GFP_KERNEL);
+    if (!y || !isum || !msum) {
+        pr_err("🦙 Fast MatMul: Failed to allocate Q8_K buffers\n");
+        goto out;
+    }
+
+    /* Quantize all activation columns once */
+    llama_fpu_begin(&fpu);
+    for (int64_t j = 0; j < ne11; j++) {
+        quantize_row_q8_K((const float *)src1->data + j * ne10,
+                          y + j * nb, ne00);
+        llama_fpu_checkpoint(&fpu);
+    }
+    llama_fpu_end(&fpu);
+
+    for (int64_t i0 = 0; i0 < ne01; i0 += tile_rows) {
+        const int64_t i1 = min(i0 + tile_rows, ne01);
+
+        /* Integer phase - no FPU, preemptible */
+        for (int64_t i = i0; i < i1; i++) {
+            const struct block_q4_K *row =
+                (const struct block_q4_K *)((const char *)src0->data + i * src0->nb[1]);
+
+            if (ahead)
+                ggml_prefetch_range((const char *)row + ahead, src0->nb[1]);
+
+            for (int64_t j = 0; j < ne11; j++) {
+                const int64_t off = ((i - i0) * ne11 + j) * nb;
+                q4k_q8k_dot_int(row, y + j * nb, nb, isum + off, msum + off);
             }
-            
-            /* Allow preemption between blocks */
-            if (need_resched()) {
-                cond_resched();
+        }
+
+        /* Float phase - one FPU region per tile */
+        llama_fpu_begin(&fpu);
+        for (int64_t i = i0; i < i1; i++) {
+            const struct block_q4_K *row =
+                (const struct block_q4_K *)((const char *)src0->data + i * src0->nb[1]);
+
+            for (int64_t j = 0; j < ne11; j++) {
+                const int64_t off = ((i - i0) * ne11 + j) * nb;
+                float *dst_ptr = (float *)dst->data + i * ne11 + j;
+                *dst_ptr = q4k_q8k_finalize(row, y + j * nb, nb,
+                                            isum + off, msum + off);
             }
         }
+        llama_fpu_end(&fpu);
+
+        cond_resched();
     }
-}
\ No newline at end of file
+
+out:
+    kvfree(msum);
+    kvfree(isum);
+    kvfree(y);
+}
@@ -0,0 +1,146 @@
+/*
+ * Per-op latency histograms for Llamux - see ggml_prof.h
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/debugfs.h>
+#include <linux/fs.h>
+#include <linux/log2.h>
+#include <linux/timekeeping.h>
+#include <asm/msr.h>
+#include <asm/tsc.h>
+#include <asm/cpufeature.h>
+#include "ggml_prof.h"
+
+static bool ggml_prof = true;
+module_param(ggml_prof, bool, 0644);
+MODULE_PARM_DESC(ggml_prof, "Record per-op latency histograms (debugfs llamux/op_latency)");
+
+#define GGML_PROF_ROWS (GGML_PROF_LAYERS + 1)
+
+/*
+ * Written only by the inference thread, so the cells are plain u64; a
+ * concurrent read or reset may see one node half-accounted.
+ */
+static struct ggml_prof_cell *ggml_prof_cells;
+static bool ggml_prof_use_tsc;
+static struct dentry *ggml_prof_dir;
+
+static inline u64 ggml_prof_now(void) {
+    return ggml_prof_use_tsc ? rdtsc_ordered() : ktime_get_ns();
+}
+
+u64 ggml_prof_start(void) {
+    if (!ggml_prof_cells || !READ_ONCE(ggml_prof))
+        return 0;
+    return ggml_prof_now();
+}
+
+void ggml_prof_record(const struct ggml_tensor *node, u64 start) {
+    struct ggml_prof_cell *cell;
+    u64 ticks;
+    int row;
+    
+    if (!start || node->op >= GGML_OP_COUNT)
+        return;
+    
+    ticks = ggml_prof_now() - start;
+    row = node->layer >= 0 && node->layer < GGML_PROF_LAYERS ? node->layer : GGML_PROF_LAYERS;
+    cell = &ggml_prof_cells[node->op * GGML_PROF_ROWS + row];
+    
+    cell->count++;
+    cell->total += ticks;
+    cell->buckets[min_t(int, ticks ? ilog2(ticks) : 0, GGML_PROF_BUCKETS - 1)]++;
+}
+
+/* Each open reads a snapshot, so a dump is consistent with itself */
+struct ggml_prof_snapshot {
+    size_t size;
+    char data[];
+};
+
+static int ggml_prof_open(struct inode *inode, struct file *file) {
+    const size_t cells = sizeof(struct ggml_prof_cell) * GGML_OP_COUNT * GGML_PROF_ROWS;
+    struct ggml_prof_snapshot *snap;
+    struct ggml_prof_header hdr = {
+        .magic = GGML_PROF_MAGIC,
+        .version = GGML_PROF_VERSION,
+        .n_ops = GGML_OP_COUNT,
+        .n_layers = GGML_PROF_LAYERS,
+        .n_buckets = GGML_PROF_BUCKETS,
+        .clock = ggml_prof_use_tsc ? GGML_PROF_CLOCK_TSC : GGML_PROF_CLOCK_NS,
+        .ticks_per_ms = ggml_prof_use_tsc ? tsc_khz : NSEC_PER_MSEC,
+    };
+    
+    /* Writers only reset */
+    if ((file->f_mode & FMODE_WRITE) && !(file->f_mode & FMODE_READ))
+        return 0;
+    
+    snap = kvmalloc(sizeof(*snap) + sizeof(hdr) + cells, GFP_KERNEL);
+    if (!snap)
+        return -ENOMEM;
+    
+    snap->size = sizeof(hdr) + cells;
+    memcpy(snap->data, &hdr, sizeof(hdr));
+    memcpy(snap->data + sizeof(hdr), ggml_prof_cells, cells);
+    file->private_data = snap;
+    
+    return 0;
+}
+
+static ssize_t ggml_prof_read(struct file *file, char __user *buf,
+                              size_t count, loff_t *ppos) {
+    struct ggml_prof_snapshot *snap = file->private_data;
+    
+    if (!snap)
+        return -EINVAL;
+    return simple_read_from_buffer(buf, count, ppos, snap->data, snap->size);
+}
+
+static ssize_t ggml_prof_write(struct file *file, const char __user *buf,
+                               size_t count, loff_t *ppos) {
+    memset(ggml_prof_cells, 0,
+           sizeof(struct ggml_prof_cell) * GGML_OP_COUNT * GGML_PROF_ROWS);
+    return count;
+}
+
+static int ggml_prof_release(struct inode *inode, struct file *file) {
+    kvfree(file->private_data);
+    return 0;
+}
+
+static const struct file_operations ggml_prof_fops = {
+    .owner = THIS_MODULE,
+    .open = ggml_prof_open,
+    .read = ggml_prof_read,
+    .write = ggml_prof_write,
+    .release = ggml_prof_release,
+    .llseek = default_llseek,
+};
+
+int ggml_prof_init(void) {
+    ggml_prof_cells = vzalloc(sizeof(struct ggml_prof_cell) * GGML_OP_COUNT * GGML_PROF_ROWS);
+    if (!ggml_prof_cells)
+        return -ENOMEM;
+    
+    /* The TSC is only a clock if it ticks at a fixed rate through C-states */
+    ggml_prof_use_tsc = boot_cpu_has(X86_FEATURE_CONSTANT_TSC) &&
+                        boot_cpu_has(X86_FEATURE_NONSTOP_TSC) && tsc_khz;
+    
+    ggml_prof_dir = debugfs_create_dir("llamux", NULL);
+    debugfs_create_file("op_latency", 0600, ggml_prof_dir, NULL, &ggml_prof_fops);
+    
+    pr_info("🦙 Prof: Per-op latency histograms in debugfs llamux/op_latency (%s clock)\n",
+            ggml_prof_use_tsc ? "TSC" : "ktime");
+    return 0;
+}
+
+void ggml_prof_exit(void) {
+    debugfs_remove_recursive(ggml_prof_dir);
+    ggml_prof_dir = NULL;
+    vfree(ggml_prof_cells);
+    ggml_prof_cells = NULL;
+}
@@ -0,0 +1,58 @@
+/*
+ * Per-op latency histograms for Llamux
+ *
+ * ggml_graph_compute() stamps every node with the TSC (ktime_get_ns()
+ * where the TSC is not usable) and folds the duration into a log2
+ * histogram keyed by op type and by the transformer layer the node was
+ * built for. The tables are read raw from debugfs:
+ *
+ *   /sys/kernel/debug/llamux/op_latency
+ *
+ * as a struct ggml_prof_header followed by
+ * n_ops * (n_layers + 1) struct ggml_prof_cell, op-major; the last row
+ * of each op holds nodes outside any layer (embeddings, output). Any
+ * write to the file resets the tables.
+ */
+
+#ifndef _LLAMUX_GGML_PROF_H
+#define _LLAMUX_GGML_PROF_H
+
+#include <linux/types.h>
+#include "ggml_kernel.h"
+
+#define GGML_PROF_MAGIC    0x464f5250  /* "PROF" */
+#define GGML_PROF_VERSION  1
+#define GGML_PROF_LAYERS   128
+#define GGML_PROF_BUCKETS  48          /* Bucket b holds [2^b, 2^(b+1)) ticks */
+
+enum ggml_prof_clock {
+    GGML_PROF_CLOCK_NS = 0,
+    GGML_PROF_CLOCK_TSC = 1,
+};
+
+struct ggml_prof_header {
+    u32 magic;
+    u32 version;
+    u32 n_ops;
+    u32 n_layers;
+    u32 n_buckets;
+    u32 clock;                  /* enum ggml_prof_clock */
+    u64 ticks_per_ms;           /* 1000000 for GGML_PROF_CLOCK_NS */
+};
+
+struct ggml_prof_cell {
+    u64 count;
+    u64 total;                  /* Ticks */
+    u64 buckets[GGML_PROF_BUCKETS];
+};
+
+int ggml_prof_init(void);
+void ggml_prof_exit(void);
+
+/* Timestamp for ggml_prof_record() - 0 while profiling is off */
+u64 ggml_prof_start(void);
+
+/* Account one node execution that began at start */
+void ggml_prof_record(const struct ggml_tensor *node, u64 start);
+
+#endif /* _LLAMUX_GGML_PROF_H */
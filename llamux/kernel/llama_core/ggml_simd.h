@@ -6,6 +6,7 @@
 #define _LLAMUX_GGML_SIMD_H
 
 #include <linux/kernel.h>
+#include <linux/string.h>
 
 /* Disable AVX2 in kernel space - no immintrin.h available */
 #ifdef __KERNEL__
@@ -81,4 +82,36 @@ static inline float ggml_vec_dot_f32(const float *x, const float *y, int n) {
     return ggml_vec_dot_f32_avx2(x, y, n);
 }
 
+/*
+ * Memory hints for the GEMV kernels. Prefetches never fault, so a
+ * prefetch distance may run past the end of the weights.
+ */
+#define GGML_CACHE_LINE 64
+
+static inline void ggml_prefetch_range(const void *p, size_t len) {
+    const char *c = (const char *)((unsigned long)p & ~(GGML_CACHE_LINE - 1UL));
+    const char *end = (const char *)p + len;
+    
+    for (; c < end; c += GGML_CACHE_LINE)
+        __builtin_prefetch(c, 0, 3);
+}
+
+/* Store that bypasses the caches; order with ggml_stream_fence() */
+static inline void ggml_store_stream_f32(float *dst, float v) {
+#ifdef CONFIG_X86_64
+    int bits;
+    
+    memcpy(&bits, &v, sizeof(bits));
+    __builtin_ia32_movnti((int *)dst, bits);
+#else
+    *dst = v;
+#endif
+}
+
+static inline void ggml_stream_fence(void) {
+#ifdef CONFIG_X86_64
+    asm volatile("sfence" ::: "memory");
+#endif
+}
+
 #endif /* _LLAMUX_GGML_SIMD_H */
\ No newline at end of file
@@ -9,9 +9,23 @@
 #include <linux/slab.h>
 #include <linux/string.h>
 #include <linux/bug.h>
+#include <linux/err.h>
+#include <linux/fs.h>
+#include <linux/module.h>
+#include <linux/kthread.h>
+#include <linux/cpumask.h>
+#include <linux/math64.h>
+#include <linux/pagemap.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/fadvise.h>
 #include "gguf_parser.h"
 #include "ggml_kernel.h"
 
+static int load_threads;
+module_param(load_threads, int, 0644);
+MODULE_PARM_DESC(load_threads, "Model loader threads (0=one per online CPU, up to 8)");
+
 /* Get size in bytes for each tensor type */
 size_t ggml_type_size(enum ggml_type type)
 {
@@ -20,6 +34,7 @@ size_t ggml_type_size(enum ggml_type type)
     case GGML_TYPE_F16:  return 2;
     case GGML_TYPE_Q4_0: return 18; /* block size for Q4_0 */
     case GGML_TYPE_Q4_1: return 20; /* block size for Q4_1 */
+    case GGML_TYPE_Q8_0: return 34; /* block size for Q8_0 */
     case GGML_TYPE_Q4_K: return 144; /* block size for Q4_K */
     case GGML_TYPE_Q5_K: return 176; /* block size for Q5_K */
     case GGML_TYPE_Q6_K: return 210; /* block size for Q6_K */
@@ -38,6 +53,7 @@ const char *ggml_type_name(enum ggml_type type)
     case GGML_TYPE_F16:  return "F16";
     case GGML_TYPE_Q4_0: return "Q4_0";
     case GGML_TYPE_Q4_1: return "Q4_1";
+    case GGML_TYPE_Q8_0: return "Q8_0";
     case GGML_TYPE_Q4_K: return "Q4_K";
     case GGML_TYPE_Q5_K: return "Q5_K";
     case GGML_TYPE_Q6_K: return "Q6_K";
@@ -62,6 +78,7 @@ size_t ggml_tensor_size(const struct gguf_tensor_info *tensor)
         switch (tensor->type) {
         case GGML_TYPE_Q4_0:
         case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q8_0:
             block_size = 32;
             break;
         case GGML_TYPE_Q4_K:
@@ -120,20 +137,25 @@ int gguf_parse_header(const void *data, size_t size, struct gguf_header *header)
     return 0;
 }
 
-/* Read a GGUF string from buffer */
-static const u8 *read_gguf_string(const u8 *ptr, char **str)
+/* Read a GGUF string from buffer; ERR_PTR(-ENODATA) if it runs past end */
+static const u8 *read_gguf_string(const u8 *ptr, const u8 *end, char **str)
 {
     u64 length;
     
     /* Read string length */
+    if (ptr + sizeof(u64) > end)
+        return ERR_PTR(-ENODATA);
     memcpy(&length, ptr, sizeof(u64));
     ptr += sizeof(u64);
     
+    if (length > (u64)(end - ptr))
+        return ERR_PTR(-ENODATA);
+    
     /* Allocate and copy string */
     *str = kzalloc(length + 1, GFP_KERNEL);
     if (!*str) {
         pr_err("🦙 Llamux: Failed to allocate %llu bytes for string\n", length + 1);
-        return NULL;
+        return ERR_PTR(-ENOMEM);
     }
     
     memcpy(*str, ptr, length);
@@ -162,11 +184,12 @@ int gguf_parse_metadata(const void *data, size_t size, struct gguf_model *model)
         
         /* Read key */
         pr_debug("🦙 Llamux: Reading metadata key %llu at offset %ld\n", i, ptr - (const u8 *)data);
-        ptr = read_gguf_string(ptr, &key);
-        if (!ptr || ptr >= end) {
-            pr_err("🦙 Llamux: Failed to read metadata key %llu at offset %ld\n", 
-                   i, ptr ? (ptr - (const u8 *)data) : -1);
-            return -EINVAL;
+        ptr = read_gguf_string(ptr, end, &key);
+        if (IS_ERR(ptr))
+            return PTR_ERR(ptr);
+        if (ptr >= end) {
+            kfree(key);
+            return -ENODATA;
         }
         
         pr_info("🦙 Llamux: Metadata key %llu: '%s'\n", i, key);
@@ -179,9 +202,9 @@ int gguf_parse_metadata(const void *data, size_t size, struct gguf_model *model)
         pr_debug("🦙 Llamux: Processing key: %s (type=%u)\n", key, value_type);
         
         if (strcmp(key, "general.name") == 0 && value_type == GGUF_TYPE_STRING) {
-            ptr = read_gguf_string(ptr, &model->model_name);
+            ptr = read_gguf_string(ptr, end, &model->model_name);
         } else if (strcmp(key, "general.architecture") == 0 && value_type == GGUF_TYPE_STRING) {
-            ptr = read_gguf_string(ptr, &model->model_arch);
+            ptr = read_gguf_string(ptr, end, &model->model_arch);
         } else if (strcmp(key, "llama.context_length") == 0 && value_type == GGUF_TYPE_UINT32) {
             memcpy(&model->context_length, ptr, sizeof(u32));
             ptr += sizeof(u32);
@@ -229,17 +252,15 @@ int gguf_parse_metadata(const void *data, size_t size, struct gguf_model *model)
                 for (u64 j = 0; j < arr_len; j++) {
                     u64 str_len;
                     if (ptr + sizeof(u64) > end) {
-                        pr_err("🦙 Llamux: Token array out of bounds\n");
                         kfree(key);
-                        return -EINVAL;
+                        return -ENODATA;
                     }
                     memcpy(&str_len, ptr, sizeof(u64));
                     ptr += sizeof(u64);
                     
-                    if (ptr + str_len > end) {
-                        pr_err("🦙 Llamux: Token string out of bounds\n");
+                    if (str_len > (u64)(end - ptr)) {
                         kfree(key);
-                        return -EINVAL;
+                        return -ENODATA;
                     }
                     
                     /* Allocate and copy token string */
@@ -281,8 +302,8 @@ int gguf_parse_metadata(const void *data, size_t size, struct gguf_model *model)
             pr_info("🦙 Llamux: Padding token ID: %u\n", model->pad_token_id);
         } else if (strcmp(key, "tokenizer.ggml.model") == 0 && value_type == GGUF_TYPE_STRING) {
             char *tokenizer_model = NULL;
-            ptr = read_gguf_string(ptr, &tokenizer_model);
-            if (tokenizer_model) {
+            ptr = read_gguf_string(ptr, end, &tokenizer_model);
+            if (!IS_ERR(ptr)) {
                 pr_info("🦙 Llamux: Tokenizer model: %s\n", tokenizer_model);
                 kfree(tokenizer_model);
             }
@@ -312,7 +333,12 @@ int gguf_parse_metadata(const void *data, size_t size, struct gguf_model *model)
                 {
                     u64 str_len;
                     memcpy(&str_len, ptr, sizeof(u64));
-                    ptr += sizeof(u64) + str_len;
+                    ptr += sizeof(u64);
+                    if (str_len > (u64)(end - ptr)) {
+                        kfree(key);
+                        return -ENODATA;
+                    }
+                    ptr += str_len;
                 }
                 break;
             case GGUF_TYPE_ARRAY:
@@ -339,23 +365,22 @@ int gguf_parse_metadata(const void *data, size_t size, struct gguf_model *model)
                             {
                                 u64 str_len;
                                 if (ptr + sizeof(u64) > end) {
-                                    pr_err("🦙 Llamux: String array out of bounds\n");
                                     kfree(key);
-                                    return -EINVAL;
+                                    return -ENODATA;
                                 }
                                 memcpy(&str_len, ptr, sizeof(u64));
                                 ptr += sizeof(u64);
                                 
-                                if (ptr + str_len > end) {
-                                    pr_err("🦙 Llamux: String in array out of bounds (len=%llu)\n", str_len);
+                                if (str_len > (u64)(end - ptr)) {
                                     kfree(key);
-                                    return -EINVAL;
+                                    return -ENODATA;
                                 }
                                 ptr += str_len;
                             }
                             break;
                         default:
                             pr_warn("🦙 Llamux: Unsupported array type %u\n", arr_type);
+                            kfree(key);
                             return -EINVAL;
                         }
                     }
@@ -369,10 +394,11 @@ int gguf_parse_metadata(const void *data, size_t size, struct gguf_model *model)
         
         kfree(key);
         
-        if (ptr >= end) {
-            pr_err("🦙 Llamux: Metadata parsing overrun at key %llu\n", i);
-            return -EINVAL;
-        }
+        if (IS_ERR(ptr))
+            return PTR_ERR(ptr);
+        if (ptr >= end)
+            return -ENODATA;
+
     }
     
     pr_info("🦙 Llamux: Successfully parsed %llu metadata entries\n", 
@@ -407,22 +433,31 @@ int gguf_parse_tensor_info(const void *data, size_t size, struct gguf_model *mod
         pr_err("🦙 Llamux: Failed to allocate tensor array\n");
         return -ENOMEM;
     }
+    /* Names are freed by gguf_free_model() even if parsing stops early */
+    model->tensor_count = model->header.tensor_count;
     
     /* Parse each tensor */
     for (i = 0; i < model->header.tensor_count; i++) {
         struct gguf_tensor_info *tensor = &model->tensors[i];
         
         /* Read tensor name */
-        ptr = read_gguf_string(ptr, &tensor->name);
-        if (!ptr || ptr >= end) {
-            pr_err("🦙 Llamux: Failed to read tensor name\n");
-            return -EINVAL;
-        }
+        ptr = read_gguf_string(ptr, end, &tensor->name);
+        if (IS_ERR(ptr))
+            return PTR_ERR(ptr);
         
         /* Read number of dimensions */
+        if (ptr + sizeof(u32) > end)
+            return -ENODATA;
         memcpy(&tensor->n_dims, ptr, sizeof(u32));
         ptr += sizeof(u32);
         
+        if (tensor->n_dims > ARRAY_SIZE(tensor->dims)) {
+            pr_err("🦙 Llamux: Tensor %s has %u dimensions\n", tensor->name, tensor->n_dims);
+            return -EINVAL;
+        }
+        if (ptr + tensor->n_dims * sizeof(u64) + sizeof(u32) + sizeof(u64) > end)
+            return -ENODATA;
+        
         /* Read dimensions */
         for (j = 0; j < tensor->n_dims; j++) {
             memcpy(&tensor->dims[j], ptr, sizeof(u64));
@@ -444,8 +479,6 @@ int gguf_parse_tensor_info(const void *data, size_t size, struct gguf_model *mod
                 i, tensor->name, ggml_type_name(tensor->type), tensor->n_dims);
     }
     
-    model->tensor_count = model->header.tensor_count;
-    
     /* Calculate data offset - align to 32 bytes */
     u64 tensor_info_end = ptr - (const u8 *)data;
     model->data_offset = (tensor_info_end + 31) & ~31ULL;
@@ -548,6 +581,279 @@ int gguf_load_tensor_data(const void *file_data, size_t file_size, struct gguf_m
     return 0;
 }
 
+/* Read len bytes at pos, riding out short reads */
+int gguf_file_read(struct file *filp, loff_t pos, void *buf, size_t len)
+{
+    u8 *dst = buf;
+    
+    while (len) {
+        ssize_t n = kernel_read(filp, dst, min_t(size_t, len, GGUF_READ_CHUNK), &pos);
+        
+        if (n <= 0) {
+            pr_err("🦙 Llamux: Read failed at offset %lld: %zd\n", pos, n);
+            return n ? n : -EIO;
+        }
+        dst += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/*
+ * Check that every tensor lies inside the file's data section and inside
+ * memory_size bytes of a buffer laid out like it. *total is how much of
+ * the section the tensors span.
+ */
+static int gguf_check_tensors(struct gguf_model *model, loff_t file_size,
+                              size_t memory_size, u64 *total)
+{
+    u64 data_size, i;
+    
+    if (!model || !model->tensors || model->data_offset > file_size) {
+        pr_err("🦙 Llamux: Invalid parameters for tensor loading\n");
+        return -EINVAL;
+    }
+    data_size = file_size - model->data_offset;
+    
+    pr_info("🦙 Llamux: Memory available: %zu MB, need %llu MB\n",
+            memory_size / (1024*1024), data_size / (1024*1024));
+    
+    *total = 0;
+    for (i = 0; i < model->tensor_count; i++) {
+        struct gguf_tensor_info *tensor = &model->tensors[i];
+        
+        if (tensor->size > data_size || tensor->offset > data_size - tensor->size) {
+            pr_err("🦙 Llamux: Tensor %s exceeds file bounds\n", tensor->name);
+            return -EINVAL;
+        }
+        
+        if (tensor->offset + tensor->size > memory_size) {
+            pr_err("🦙 Llamux: Not enough memory for tensor %s (need %llu MB, %zu MB total)\n",
+                   tensor->name, (tensor->offset + tensor->size) / (1024*1024),
+                   memory_size / (1024*1024));
+            return -ENOMEM;
+        }
+        
+        *total = max_t(u64, *total, tensor->offset + tensor->size);
+    }
+    
+    return 0;
+}
+
+static void gguf_loader_put(struct gguf_loader *ld)
+{
+    if (atomic_dec_and_test(&ld->active))
+        complete(&ld->done);
+}
+
+/* Claim chunks of the data section until it is all read or a read fails */
+static int gguf_loader_thread(void *data)
+{
+    struct gguf_loader *ld = data;
+    u64 off;
+    
+    while (!READ_ONCE(ld->error) &&
+           (off = atomic64_fetch_add(GGUF_LOAD_CHUNK, &ld->next)) < ld->size) {
+        size_t len = min_t(u64, GGUF_LOAD_CHUNK, ld->size - off);
+        int ret = gguf_file_read(ld->filp, ld->base + off, ld->dst + off, len);
+        
+        if (ret) {
+            cmpxchg(&ld->error, 0, ret);
+            break;
+        }
+    }
+    
+    gguf_loader_put(ld);
+    return 0;
+}
+
+/*
+ * Start reading tensor data from the file straight into tensor_memory.
+ * The arena is laid out like the file's data section, so every tensor
+ * lands at its own offset and keeps the GGUF alignment. tensor->data is
+ * set before this returns, but the bytes behind it are only valid once
+ * gguf_load_wait() succeeds; if it fails it resets them to NULL. The
+ * section is split into chunks that load_threads kthreads claim in
+ * order, each reading at its own offset, so the device sees several
+ * requests in flight.
+ */
+int gguf_load_start(struct gguf_loader *ld, struct file *filp, loff_t file_size,
+                    struct gguf_model *model, void *tensor_memory, size_t memory_size)
+{
+    u8 *mem_ptr = (u8 *)tensor_memory;
+    u64 total_size;
+    u64 i;
+    int n_threads, t, ret;
+    
+    memset(ld, 0, sizeof(*ld));
+    
+    if (!filp || !tensor_memory) {
+        pr_err("🦙 Llamux: Invalid parameters for tensor loading\n");
+        return -EINVAL;
+    }
+    
+    pr_info("🦙 Llamux: Reading tensor data from offset %llu\n", model->data_offset);
+    
+    /* Nothing is read unless every tensor fits */
+    ret = gguf_check_tensors(model, file_size, memory_size, &total_size);
+    if (ret)
+        return ret;
+    
+    for (i = 0; i < model->tensor_count; i++)
+        model->tensors[i].data = mem_ptr + model->tensors[i].offset;
+    
+    ld->filp = filp;
+    ld->model = model;
+    ld->base = model->data_offset;
+    ld->dst = mem_ptr;
+    ld->size = total_size;
+    ld->start = ktime_get();
+    atomic64_set(&ld->next, 0);
+    atomic_set(&ld->active, 1);  /* Dropped by gguf_load_wait() */
+    init_completion(&ld->done);
+    
+    n_threads = load_threads > 0 ? load_threads : min(num_online_cpus(), 8U);
+    n_threads = clamp_t(u64, DIV_ROUND_UP(total_size, GGUF_LOAD_CHUNK), 1, n_threads);
+    
+    for (t = 0; t < n_threads; t++) {
+        struct task_struct *task;
+        
+        atomic_inc(&ld->active);
+        task = kthread_run(gguf_loader_thread, ld, "llamux_load/%d", t);
+        if (IS_ERR(task)) {
+            atomic_dec(&ld->active);
+            break;
+        }
+        ld->n_threads++;
+    }
+    
+    pr_info("🦙 Llamux: Loading %llu MB of tensor data with %d threads\n",
+            total_size / (1024*1024), ld->n_threads);
+    return 0;
+}
+
+/* Wait for gguf_load_start() to finish; reads inline if no thread started */
+int gguf_load_wait(struct gguf_loader *ld)
+{
+    s64 ms;
+    
+    if (!ld->n_threads) {
+        atomic_inc(&ld->active);
+        gguf_loader_thread(ld);
+    }
+    
+    gguf_loader_put(ld);
+    wait_for_completion(&ld->done);
+    
+    if (ld->error) {
+        u64 i;
+        
+        /* The arena is partly unread - nothing behind these is valid */
+        for (i = 0; i < ld->model->tensor_count; i++)
+            ld->model->tensors[i].data = NULL;
+        pr_err("🦙 Llamux: Tensor data load failed: %d\n", ld->error);
+        return ld->error;
+    }
+    
+    ms = ktime_ms_delta(ktime_get(), ld->start);
+    pr_info("🦙 Llamux: Read %llu MB of tensor data in %lld ms (%lld MB/s)\n",
+            ld->size / (1024*1024), ms,
+            ms ? div64_s64((s64)(ld->size / (1024*1024)) * 1000, ms) : 0);
+    return 0;
+}
+
+/*
+ * Alias the tensors onto the file's page cache instead of copying them.
+ * Every page of the data section is read in (or found already cached),
+ * pinned with a page reference and vmapped read-only, so tensor->data
+ * points into memory shared with anyone else who has the file cached or
+ * mapped. The file can be closed afterwards; the references keep the
+ * pages until gguf_unmap_tensor_data().
+ */
+int gguf_map_tensor_data(struct gguf_mapping *map, struct file *filp, loff_t file_size,
+                         struct gguf_model *model)
+{
+    struct address_space *mapping = filp->f_mapping;
+    ktime_t start = ktime_get();
+    u64 total_size, i;
+    unsigned long n;
+    pgoff_t first;
+    u8 *base;
+    int ret;
+    
+    memset(map, 0, sizeof(*map));
+    
+    pr_info("🦙 Llamux: Mapping tensor data from offset %llu\n", model->data_offset);
+    
+    ret = gguf_check_tensors(model, file_size, file_size - model->data_offset, &total_size);
+    if (ret)
+        return ret;
+    
+    first = model->data_offset >> PAGE_SHIFT;
+    map->n_pages = DIV_ROUND_UP(model->data_offset + total_size, PAGE_SIZE) - first;
+    map->pages = kvmalloc_array(map->n_pages, sizeof(struct page *), GFP_KERNEL);
+    if (!map->pages)
+        return -ENOMEM;
+    
+    /* Queue reads for whatever isn't cached so pages don't come in one by one */
+    vfs_fadvise(filp, (loff_t)first << PAGE_SHIFT, (loff_t)map->n_pages << PAGE_SHIFT,
+                POSIX_FADV_WILLNEED);
+    
+    for (n = 0; n < map->n_pages; n++) {
+        struct page *page = read_mapping_page(mapping, first + n, filp);
+        
+        if (IS_ERR(page)) {
+            ret = PTR_ERR(page);
+            pr_err("🦙 Llamux: Failed to read page %lu of the model: %d\n", first + n, ret);
+            goto err_put;
+        }
+        map->pages[n] = page;
+        
+        if (!(n & 4095))
+            cond_resched();
+    }
+    
+    map->vaddr = vmap(map->pages, map->n_pages, VM_MAP, PAGE_KERNEL_RO);
+    if (!map->vaddr) {
+        pr_err("🦙 Llamux: Failed to vmap %lu model pages\n", map->n_pages);
+        ret = -ENOMEM;
+        goto err_put;
+    }
+    
+    model->data_readonly = true;
+    base = (u8 *)map->vaddr + offset_in_page(model->data_offset);
+    for (i = 0; i < model->tensor_count; i++)
+        model->tensors[i].data = base + model->tensors[i].offset;
+    
+    pr_info("🦙 Llamux: Mapped %lu MB of tensor data from the page cache in %lld ms\n",
+            (map->n_pages << PAGE_SHIFT) / (1024*1024),
+            ktime_ms_delta(ktime_get(), start));
+    return 0;
+    
+err_put:
+    while (n--)
+        put_page(map->pages[n]);
+    kvfree(map->pages);
+    map->pages = NULL;
+    map->n_pages = 0;
+    return ret;
+}
+
+/* Undo gguf_map_tensor_data() - tensor data pointers are dangling after this */
+void gguf_unmap_tensor_data(struct gguf_mapping *map)
+{
+    unsigned long n;
+    
+    if (!map->vaddr)
+        return;
+    
+    vunmap(map->vaddr);
+    for (n = 0; n < map->n_pages; n++)
+        put_page(map->pages[n]);
+    kvfree(map->pages);
+    memset(map, 0, sizeof(*map));
+}
+
 /* Print model info */
 void gguf_print_model_info(struct gguf_model *model) {
     if (!model) return;
@@ -614,9 +920,9 @@ struct ggml_tensor *gguf_tensor_to_ggml(struct ggml_context *ctx,
         tensor->ne[i] = i < info->n_dims ? info->dims[i] : 1;
         if (i == 0) {
             tensor->nb[i] = ggml_type_size(info->type);
-        } else if (i == 1 && info->type == GGML_TYPE_Q4_K) {
-            /* For Q4_K, each row is ne[0]/256 blocks of 144 bytes */
-            tensor->nb[i] = (tensor->ne[0] / 256) * 144;
+        } else if (i == 1 && info->type != GGML_TYPE_F32 && info->type != GGML_TYPE_F16) {
+            /* Quantized rows are ne[0]/block elements of block bytes each */
+            tensor->nb[i] = gguf_tensor_size(info->type, tensor->ne[0]);
         } else {
             tensor->nb[i] = tensor->nb[i-1] * tensor->ne[i-1];
         }
@@ -654,6 +960,8 @@ size_t gguf_tensor_size(enum ggml_type type, int64_t n_elements) {
             return n_elements * sizeof(uint16_t);
         case GGML_TYPE_Q4_0:
             return (n_elements / 32) * 18;
+        case GGML_TYPE_Q8_0:
+            return (n_elements / 32) * 34;
         case GGML_TYPE_Q4_K:
             return (n_elements / 256) * 144;
         case GGML_TYPE_Q5_K:
@@ -11,10 +11,15 @@
 #define _LLAMUX_GGUF_PARSER_H
 
 #include <linux/types.h>
+#include <linux/atomic.h>
+#include <linux/completion.h>
+#include <linux/ktime.h>
 
 /* Forward declarations */
 struct ggml_context;
 struct ggml_tensor;
+struct file;
+struct page;
 
 /* GGUF magic number */
 #define GGUF_MAGIC 0x46554747  /* "GGUF" */
@@ -22,6 +27,12 @@ struct ggml_tensor;
 #define GGUF_VERSION_V3 3
 #define GGUF_VERSION GGUF_VERSION_V3  /* Default/latest */
 
+/* Largest single kernel_read() issued while loading */
+#define GGUF_READ_CHUNK (64UL * 1024 * 1024)
+
+/* Unit of work the loader threads claim */
+#define GGUF_LOAD_CHUNK (16UL * 1024 * 1024)
+
 /* GGUF value types */
 enum gguf_type {
     GGUF_TYPE_UINT8   = 0,
@@ -45,6 +56,7 @@ enum ggml_type {
     GGML_TYPE_F16  = 1,
     GGML_TYPE_Q4_0 = 2,
     GGML_TYPE_Q4_1 = 3,
+    GGML_TYPE_Q8_0 = 8,
     GGML_TYPE_Q4_K = 12,
     GGML_TYPE_Q5_K = 13,
     GGML_TYPE_Q6_K = 14,
@@ -117,13 +129,47 @@ struct gguf_model {
     void *data;           /* Model data */
     size_t data_size;     /* Total data size */
     u64 data_offset;      /* Offset to tensor data in file */
+    bool data_readonly;   /* Tensor data aliases the page cache */
+};
+
+/* Parallel tensor data load, see gguf_load_start() */
+struct gguf_loader {
+    struct file *filp;
+    struct gguf_model *model;
+    loff_t base;          /* File offset of the data section */
+    u8 *dst;              /* Arena the data section is read into */
+    u64 size;             /* Bytes to read */
+    atomic64_t next;      /* Next chunk to claim */
+    atomic_t active;      /* Running threads, plus one for the waiter */
+    int error;            /* First read error */
+    int n_threads;
+    ktime_t start;
+    struct completion done;
 };
 
-/* Function prototypes */
+/* Data section aliased onto the file's page cache, see gguf_map_tensor_data() */
+struct gguf_mapping {
+    struct page **pages;  /* Pinned page-cache pages, in file order */
+    unsigned long n_pages;
+    void *vaddr;          /* Read-only vmap of pages */
+};
+
+/*
+ * Function prototypes. The parsers return -ENODATA when the header runs
+ * past the end of the buffer - a longer prefix of the file may parse -
+ * and -EINVAL when it is malformed.
+ */
 int gguf_parse_header(const void *data, size_t size, struct gguf_header *header);
 int gguf_parse_metadata(const void *data, size_t size, struct gguf_model *model);
 int gguf_parse_tensor_info(const void *data, size_t size, struct gguf_model *model);
 int gguf_load_tensor_data(const void *file_data, size_t file_size, struct gguf_model *model, void *tensor_memory, size_t memory_size);
+int gguf_file_read(struct file *filp, loff_t pos, void *buf, size_t len);
+int gguf_load_start(struct gguf_loader *ld, struct file *filp, loff_t file_size,
+                    struct gguf_model *model, void *tensor_memory, size_t memory_size);
+int gguf_load_wait(struct gguf_loader *ld);
+int gguf_map_tensor_data(struct gguf_mapping *map, struct file *filp, loff_t file_size,
+                         struct gguf_model *model);
+void gguf_unmap_tensor_data(struct gguf_mapping *map);
 int gguf_validate_model(struct gguf_model *model);
 void gguf_free_model(struct gguf_model *model);
 void gguf_print_model_info(struct gguf_model *model);
@@ -132,5 +178,7 @@ struct ggml_tensor *gguf_tensor_to_ggml(struct ggml_context *ctx, struct gguf_te
 
 /* Tensor operations */
 size_t gguf_tensor_size(enum ggml_type type, int64_t n_elements);
+size_t ggml_type_size(enum ggml_type type);
+const char *ggml_type_name(enum ggml_type type);
 
 #endif /* _LLAMUX_GGUF_PARSER_H */
\ No newline at end of file
@@ -16,7 +16,13 @@
 #include <linux/vmalloc.h>
 #include <linux/hugetlb.h>
 #include <linux/list.h>
-#include <asm/fpu/api.h>
+#include <linux/completion.h>
+#include <linux/refcount.h>
+#include <linux/overflow.h>
+#include <linux/moduleparam.h>
+#include <linux/topology.h>
+#include <linux/string.h>
+#include <linux/sched/clock.h>
 #include <asm/msr.h>
 
 #include "llama_accel.h"
@@ -26,77 +32,390 @@
 /* Global acceleration engine */
 struct llama_accel_engine *llama_accel = NULL;
 
+/* Spin window cap for idle compute threads, see llama_compute_spin() */
+static uint compute_spin_us = 50;
+module_param(compute_spin_us, uint, 0644);
+MODULE_PARM_DESC(compute_spin_us, "Max microseconds an idle compute thread polls before sleeping (0=never spin)");
+
+#define LLAMA_SPIN_MIN_NS 2000
+
 /* Forward declarations */
 static int llama_compute_thread_fn(void *data);
 static void llama_process_request(struct llama_compute_request *req);
+static void llama_prefetch_range(const void *addr, size_t len);
+
+/*
+ * One llama_accel_parallel_for() call. With helpers it is allocated, as
+ * helper requests still queued when the caller returns keep it alive.
+ */
+struct llama_task_group {
+    llama_parallel_fn fn;
+    void *ctx;
+    long n;
+    long grain;
+    atomic_long_t next;         /* Start of the next unclaimed chunk */
+    atomic_t error;             /* First error, 0 if none */
+    atomic_t active;            /* Caller and helpers inside, 0 once closed */
+    atomic_t workers;           /* Last worker index handed to a helper */
+    refcount_t refs;            /* Caller and helper requests */
+    struct completion done;
+    struct llama_compute_request reqs[];    /* One per helper */
+};
+
+/* Claim and run chunks until the range is exhausted or a chunk fails */
+static void llama_task_group_run(struct llama_task_group *tg, int worker) {
+    while (!atomic_read(&tg->error)) {
+        long start = atomic_long_fetch_add(tg->grain, &tg->next);
+        int ret;
+        
+        if (start >= tg->n)
+            break;
+        
+        ret = tg->fn(tg->ctx, worker, start, min(start + tg->grain, tg->n));
+        if (ret < 0)
+            atomic_cmpxchg(&tg->error, 0, ret);
+    }
+}
+
+/*
+ * A helper joins only while the group is open. Once the caller has left
+ * every chunk is claimed, so a late helper has nothing to do.
+ */
+static void llama_task_group_help(struct llama_task_group *tg) {
+    if (!atomic_inc_not_zero(&tg->active))
+        return;
+    
+    llama_task_group_run(tg, atomic_inc_return(&tg->workers));
+    if (atomic_dec_and_test(&tg->active))
+        complete(&tg->done);
+}
+
+static void llama_task_group_put(struct llama_task_group *tg) {
+    if (refcount_dec_and_test(&tg->refs))
+        kfree(tg);
+}
+
+static void llama_task_group_helper_done(struct llama_compute_request *req) {
+    llama_task_group_put(req->context);
+}
 
 /*
  * Memory pool management
  */
+static struct llama_mem_pool *llama_weight_pool;
+static struct llama_mem_pool *llama_activation_pool;
+
 static struct llama_mem_pool *llama_mem_pool_create(size_t size, const char *name) {
     struct llama_mem_pool *pool;
-    int nr_pages;
+    struct llama_mem_extent *ext;
     
     pool = kzalloc(sizeof(*pool), GFP_KERNEL);
-    if (!pool)
-        return NULL;
-    
-    /* Try to allocate 1GB huge pages first */
-    nr_pages = size / HUGE_PAGE_SIZE;
-    if (nr_pages > 0) {
-        pool->base_addr = vmalloc_huge(size, GFP_KERNEL);
-        if (pool->base_addr) {
-            pr_info("🦙 Accel: Allocated %zu MB using huge pages for %s\n",
-                    size / (1024 * 1024), name);
-            pool->nr_hugepages = nr_pages;
-        }
-    }
+    ext = kzalloc(sizeof(*ext), GFP_KERNEL);
+    if (!pool || !ext)
+        goto err_free;
     
-    /* Fall back to regular vmalloc */
+    /* Whole PMDs, so the tail of the area is huge-mapped too */
+    size = ALIGN(size, PMD_SIZE);
+    pool->base_addr = vmalloc_huge(size, GFP_KERNEL);
     if (!pool->base_addr) {
-        pool->base_addr = vmalloc(size);
-        if (!pool->base_addr) {
-            kfree(pool);
-            return NULL;
-        }
-        pr_info("🦙 Accel: Allocated %zu MB using regular pages for %s\n",
-                size / (1024 * 1024), name);
+        pr_err("🦙 Accel: Failed to allocate %zu MB for %s\n",
+               size / (1024 * 1024), name);
+        goto err_free;
     }
+    pr_info("🦙 Accel: Allocated %zu MB using huge pages for %s\n",
+            size / (1024 * 1024), name);
     
     pool->size = size;
     pool->used = 0;
+    pool->name = name;
     mutex_init(&pool->lock);
+    INIT_LIST_HEAD(&pool->free_list);
+    INIT_LIST_HEAD(&pool->used_list);
+    
+    ext->offset = 0;
+    ext->size = size;
+    list_add(&ext->list, &pool->free_list);
     
     return pool;
+    
+err_free:
+    kfree(ext);
+    kfree(pool);
+    return NULL;
 }
 
 static void llama_mem_pool_destroy(struct llama_mem_pool *pool) {
+    struct llama_mem_extent *ext, *tmp;
+    
     if (!pool)
         return;
     
-    if (pool->base_addr)
-        vfree(pool->base_addr);
+    if (!list_empty(&pool->used_list))
+        pr_warn("🦙 Accel: %s pool destroyed with %zu bytes in use\n",
+                pool->name, pool->used);
     
+    list_for_each_entry_safe(ext, tmp, &pool->free_list, list)
+        kfree(ext);
+    list_for_each_entry_safe(ext, tmp, &pool->used_list, list)
+        kfree(ext);
+    
+    vfree(pool->base_addr);
     kfree(pool);
 }
 
+/* First fit; the alignment padding stays with the allocation */
+static void *llama_mem_pool_alloc(struct llama_mem_pool *pool, size_t size, size_t align) {
+    struct llama_mem_extent *ext, *used;
+    void *ptr = NULL;
+    
+    size = ALIGN(size ? size : 1, LLAMA_POOL_ALIGN);
+    align = max_t(size_t, align, LLAMA_POOL_ALIGN);
+    
+    used = kzalloc(sizeof(*used), GFP_KERNEL);
+    if (!used)
+        return NULL;
+    
+    mutex_lock(&pool->lock);
+    list_for_each_entry(ext, &pool->free_list, list) {
+        size_t start = ALIGN(ext->offset, align);
+        size_t end = start + size;
+        
+        if (end > ext->offset + ext->size)
+            continue;
+        
+        used->offset = ext->offset;
+        used->size = end - ext->offset;
+        used->ptr = pool->base_addr + start;
+        list_add(&used->list, &pool->used_list);
+        pool->used += used->size;
+        ptr = used->ptr;
+        used = NULL;
+        
+        /* Shrink the free range from the front, dropping it once empty */
+        ext->size -= end - ext->offset;
+        ext->offset = end;
+        if (!ext->size) {
+            list_del(&ext->list);
+            kfree(ext);
+        }
+        break;
+    }
+    mutex_unlock(&pool->lock);
+    
+    kfree(used);  /* NULL if it was used */
+    return ptr;
+}
+
+static bool llama_mem_pool_contains(struct llama_mem_pool *pool, const void *ptr) {
+    return pool && ptr >= pool->base_addr && ptr < pool->base_addr + pool->size;
+}
+
+/* Return a range to the free list, merging with the ranges either side */
+static void llama_mem_pool_free(struct llama_mem_pool *pool, void *ptr) {
+    struct llama_mem_extent *ext, *found = NULL, *prev = NULL, *next = NULL;
+    
+    mutex_lock(&pool->lock);
+    list_for_each_entry(ext, &pool->used_list, list) {
+        if (ext->ptr == ptr) {
+            found = ext;
+            break;
+        }
+    }
+    if (!found) {
+        mutex_unlock(&pool->lock);
+        pr_warn("🦙 Accel: Freeing unknown %s pool pointer %p\n", pool->name, ptr);
+        return;
+    }
+    list_del(&found->list);
+    pool->used -= found->size;
+    
+    list_for_each_entry(ext, &pool->free_list, list) {
+        if (ext->offset > found->offset) {
+            next = ext;
+            break;
+        }
+        prev = ext;
+    }
+    
+    if (prev && prev->offset + prev->size == found->offset) {
+        prev->size += found->size;
+        kfree(found);
+        found = prev;
+    } else if (next) {
+        list_add_tail(&found->list, &next->list);
+    } else {
+        list_add_tail(&found->list, &pool->free_list);
+    }
+    
+    if (next && found->offset + found->size == next->offset) {
+        found->size += next->size;
+        list_del(&next->list);
+        kfree(next);
+    }
+    mutex_unlock(&pool->lock);
+}
+
+/*
+ * Lock-free request rings
+ */
+static struct llama_compute_ring *llama_ring_create(int node) {
+    struct llama_compute_ring *ring;
+    
+    BUILD_BUG_ON(COMPUTE_RING_SIZE & (COMPUTE_RING_SIZE - 1));
+    
+    ring = kzalloc_node(sizeof(*ring), GFP_KERNEL, node);
+    if (!ring)
+        return NULL;
+    
+    /* Slot i is free for the producer holding ticket i */
+    for (int i = 0; i < COMPUTE_RING_SIZE; i++)
+        atomic_long_set(&ring->slots[i].seq, i);
+    
+    return ring;
+}
+
+/* Queue a request; false if the ring is full */
+static bool llama_ring_push(struct llama_compute_ring *ring,
+                            struct llama_compute_request *req) {
+    long pos = atomic_long_read(&ring->tail);
+    
+    for (;;) {
+        struct llama_ring_slot *slot = &ring->slots[pos & (COMPUTE_RING_SIZE - 1)];
+        long diff = atomic_long_read_acquire(&slot->seq) - pos;
+        
+        if (diff == 0) {
+            /* Slot is free - claim the ticket, then fill and hand it over */
+            if (atomic_long_try_cmpxchg(&ring->tail, &pos, pos + 1)) {
+                slot->req = req;
+                atomic_long_set_release(&slot->seq, pos + 1);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;   /* Consumer hasn't freed this slot yet */
+        } else {
+            pos = atomic_long_read(&ring->tail);
+        }
+    }
+}
+
+/* Take the oldest request; NULL if the ring is empty. Safe from any thread */
+static struct llama_compute_request *llama_ring_pop(struct llama_compute_ring *ring) {
+    long pos = atomic_long_read(&ring->head);
+    
+    for (;;) {
+        struct llama_ring_slot *slot = &ring->slots[pos & (COMPUTE_RING_SIZE - 1)];
+        long diff = atomic_long_read_acquire(&slot->seq) - (pos + 1);
+        
+        if (diff == 0) {
+            if (atomic_long_try_cmpxchg(&ring->head, &pos, pos + 1)) {
+                struct llama_compute_request *req = slot->req;
+                
+                /* Free the slot for the producer one lap ahead */
+                atomic_long_set_release(&slot->seq, pos + COMPUTE_RING_SIZE);
+                return req;
+            }
+        } else if (diff < 0) {
+            return NULL;    /* Producer hasn't filled this slot yet */
+        } else {
+            pos = atomic_long_read(&ring->head);
+        }
+    }
+}
+
+static bool llama_ring_empty(struct llama_compute_ring *ring) {
+    return atomic_long_read(&ring->head) == atomic_long_read(&ring->tail);
+}
+
+/*
+ * Own ring first, then steal from siblings starting with the next one.
+ * Background work (prefetch) only once every thread ring is empty, so it
+ * never holds up a parallel_for helper queued behind it.
+ */
+static struct llama_compute_request *llama_accel_next_request(struct llama_compute_thread *thread) {
+    const int n = llama_accel->nr_compute_threads;
+    struct llama_compute_request *req;
+    
+    req = llama_ring_pop(thread->ring);
+    if (req)
+        return req;
+    
+    for (int i = 1; i < n; i++) {
+        struct llama_compute_thread *victim = &llama_accel->threads[(thread->index + i) % n];
+        
+        req = llama_ring_pop(victim->ring);
+        if (req) {
+            atomic64_inc(&thread->requests_stolen);
+            return req;
+        }
+    }
+    
+    return llama_ring_pop(llama_accel->idle_ring);
+}
+
+/* Anything this thread could run, own or stolen */
+static bool llama_accel_has_work(struct llama_compute_thread *thread) {
+    for (int i = 0; i < llama_accel->nr_compute_threads; i++) {
+        if (!llama_ring_empty(llama_accel->threads[i].ring))
+            return true;
+    }
+    return !llama_ring_empty(llama_accel->idle_ring);
+}
+
+/* Run a request, account it and signal its submitter; returns ns spent running */
+static u64 llama_accel_run_request(struct llama_compute_request *req) {
+    const enum llama_compute_op op = req->op;
+    u64 start = ktime_get_ns();
+    u64 ran;
+    
+    llama_process_request(req);
+    ran = req->complete_time - start;
+    atomic_dec(&llama_accel->pending_requests);
+    
+    /* req may be gone once complete() has run */
+    if (op < LLAMA_OP_COUNT) {
+        struct llama_accel_op_stats *st = &llama_accel->op_stats[op];
+        
+        atomic64_inc(&st->count);
+        atomic64_add(ran, &st->run_ns);
+        atomic64_add(start - req->submit_time, &st->wait_ns);
+    }
+    atomic64_add(ran, &llama_accel->total_compute_ns);
+    
+    if (req->complete)
+        req->complete(req);
+    
+    return ran;
+}
+
 /*
  * CPU isolation and affinity
  */
-static int llama_setup_compute_thread(struct llama_compute_thread *thread, int cpu) {
+static int llama_setup_compute_thread(struct llama_compute_thread *thread, int cpu, int index) {
     
     thread->cpu_id = cpu;
-    INIT_LIST_HEAD(&thread->work_list);
-    spin_lock_init(&thread->work_lock);
+    thread->index = index;
     init_waitqueue_head(&thread->work_wait);
+    thread->start_ns = ktime_get_ns();
     atomic64_set(&thread->requests_processed, 0);
-    atomic64_set(&thread->total_cycles, 0);
+    atomic64_set(&thread->requests_stolen, 0);
+    atomic64_set(&thread->spin_wakeups, 0);
+    atomic64_set(&thread->sleeps, 0);
+    thread->avg_gap_ns = 0;
+    thread->spin_ns = (u64)READ_ONCE(compute_spin_us) * NSEC_PER_USEC;
+    atomic64_set(&thread->busy_ns, 0);
+    atomic64_set(&thread->spin_time_ns, 0);
+    
+    thread->ring = llama_ring_create(cpu_to_node(cpu));
+    if (!thread->ring)
+        return -ENOMEM;
     
     /* Create high-priority kernel thread */
     thread->task = kthread_create(llama_compute_thread_fn, thread,
                                   "llama_compute_%d", cpu);
     if (IS_ERR(thread->task)) {
         pr_err("🦙 Accel: Failed to create compute thread for CPU %d\n", cpu);
+        kfree(thread->ring);
+        thread->ring = NULL;
         return PTR_ERR(thread->task);
     }
     
@@ -114,54 +433,133 @@ static int llama_setup_compute_thread(struct llama_compute_thread *thread, int c
     return 0;
 }
 
+/* Start one compute thread per CPU in cpus, up to MAX_COMPUTE_THREADS */
+static int llama_accel_start_threads(const struct cpumask *cpus) {
+    int cpu, ret;
+    
+    llama_accel->nr_compute_threads = 0;
+    for_each_cpu(cpu, cpus) {
+        if (llama_accel->nr_compute_threads >= MAX_COMPUTE_THREADS)
+            break;
+        
+        ret = llama_setup_compute_thread(
+            &llama_accel->threads[llama_accel->nr_compute_threads], cpu,
+            llama_accel->nr_compute_threads);
+        if (ret)
+            return ret;
+        
+        llama_accel->nr_compute_threads++;
+    }
+    
+    return llama_accel->nr_compute_threads ? 0 : -ENODEV;
+}
+
+/* Stop every compute thread and complete what was left in their rings */
+static void llama_accel_stop_threads(void) {
+    struct llama_compute_request *req;
+    int i;
+    
+    for (i = 0; i < llama_accel->nr_compute_threads; i++) {
+        if (llama_accel->threads[i].task)
+            kthread_stop(llama_accel->threads[i].task);
+    }
+    
+    /* Complete anything still queued so no submitter waits forever */
+    for (i = 0; i < llama_accel->nr_compute_threads; i++) {
+        while ((req = llama_ring_pop(llama_accel->threads[i].ring)) != NULL)
+            llama_accel_run_request(req);
+        kfree(llama_accel->threads[i].ring);
+    }
+    while ((req = llama_ring_pop(llama_accel->idle_ring)) != NULL)
+        llama_accel_run_request(req);
+    
+    memset(llama_accel->threads, 0, sizeof(llama_accel->threads));
+    llama_accel->nr_compute_threads = 0;
+}
+
+/*
+ * Spin-then-sleep. A decode step issues hundreds of small parallel ops a
+ * few microseconds apart, each of which would otherwise pay a full
+ * wakeup. After draining its work a thread polls the rings for a window
+ * of twice the average gap it has seen between bursts; when gaps are
+ * longer than compute_spin_us (idle, or between requests) the window
+ * drops to zero and the thread sleeps straight away.
+ */
+/* Fold the gap since the thread went idle into its spin window */
+static void llama_compute_tune_spin(struct llama_compute_thread *thread, u64 gap) {
+    const u64 max_ns = (u64)READ_ONCE(compute_spin_us) * NSEC_PER_USEC;
+    u64 window;
+    
+    /* Clamp so one long idle period decays out within a few ops */
+    gap = min(gap, 4 * max_ns);
+    thread->avg_gap_ns = thread->avg_gap_ns - (thread->avg_gap_ns >> 3) + (gap >> 3);
+    
+    window = max_t(u64, 2 * thread->avg_gap_ns, LLAMA_SPIN_MIN_NS);
+    thread->spin_ns = window <= max_ns ? window : 0;
+}
+
+/* Poll for work until the spin window closes; true if some showed up */
+static bool llama_compute_spin(struct llama_compute_thread *thread, u64 idle_start) {
+    const u64 window = thread->spin_ns;
+    bool found = false;
+    u64 now;
+    
+    if (!window)
+        return false;
+    
+    while ((now = local_clock()) - idle_start < window) {
+        if (llama_accel_has_work(thread)) {
+            found = true;
+            break;
+        }
+        if (kthread_should_stop() || need_resched())
+            break;
+        cpu_relax();
+    }
+    
+    atomic64_add(now - idle_start, &thread->spin_time_ns);
+    return found;
+}
+
 /*
  * Compute thread main function
  */
 static int llama_compute_thread_fn(void *data) {
     struct llama_compute_thread *thread = data;
     struct llama_compute_request *req;
-    unsigned long flags;
+    u64 idle_start;
     
     pr_info("🦙 Accel: Compute thread started on CPU %d\n", thread->cpu_id);
     
-    /* Disable preemption for this thread */
-    set_current_state(TASK_INTERRUPTIBLE);
+    idle_start = local_clock();
     
     while (!kthread_should_stop()) {
-        /* Wait for work */
-        wait_event_interruptible(thread->work_wait,
-                                !list_empty(&thread->work_list) ||
-                                kthread_should_stop());
+        /* Poll briefly if work usually comes back quickly, else sleep */
+        if (llama_compute_spin(thread, idle_start)) {
+            atomic64_inc(&thread->spin_wakeups);
+        } else {
+            /* Wait for work - ours or a sibling's */
+            atomic64_inc(&thread->sleeps);
+            wait_event_interruptible(thread->work_wait,
+                                    llama_accel_has_work(thread) ||
+                                    kthread_should_stop());
+        }
         
         if (kthread_should_stop())
             break;
         
-        /* Get next request */
-        spin_lock_irqsave(&thread->work_lock, flags);
-        if (!list_empty(&thread->work_list)) {
-            /* For now, just get the first request pointer stored in context */
-            struct list_head *entry = thread->work_list.next;
-            list_del(entry);
-            req = (struct llama_compute_request *)entry;
-        } else {
-            req = NULL;
-        }
-        spin_unlock_irqrestore(&thread->work_lock, flags);
+        llama_compute_tune_spin(thread, local_clock() - idle_start);
         
-        if (req) {
-            u64 start_cycles = ktime_get_ns();
-            
-            /* Process the request */
-            llama_process_request(req);
-            
-            u64 end_cycles = ktime_get_ns();
-            atomic64_add(end_cycles - start_cycles, &thread->total_cycles);
+        /* Drain until every ring is empty, then go back to waiting */
+        while ((req = llama_accel_next_request(thread)) != NULL) {
+            atomic64_add(llama_accel_run_request(req), &thread->busy_ns);
             atomic64_inc(&thread->requests_processed);
             
-            /* Call completion callback */
-            if (req->complete)
-                req->complete(req);
+            if (kthread_should_stop())
+                break;
         }
+        
+        idle_start = local_clock();
     }
     
     pr_info("🦙 Accel: Compute thread on CPU %d stopping\n", thread->cpu_id);
@@ -173,14 +571,6 @@ static int llama_compute_thread_fn(void *data) {
  */
 static void llama_process_request(struct llama_compute_request *req) {
     switch (req->op) {
-    case LLAMA_OP_MATMUL_Q4K:
-        /* Use optimized matrix multiplication */
-        kernel_fpu_begin();
-        llama_accel_matmul_q4k(req->src0, req->src1, req->dst,
-                              req->m, req->n, req->k);
-        kernel_fpu_end();
-        break;
-        
     case LLAMA_OP_ATTENTION:
         /* Implement attention mechanism */
         pr_debug("🦙 Accel: Processing attention operation\n");
@@ -191,6 +581,14 @@ static void llama_process_request(struct llama_compute_request *req) {
         pr_debug("🦙 Accel: Processing softmax operation\n");
         break;
         
+    case LLAMA_OP_PARALLEL_FOR:
+        llama_task_group_help(req->context);
+        break;
+        
+    case LLAMA_OP_PREFETCH:
+        llama_prefetch_range(req->src0, req->m);
+        break;
+        
     default:
         pr_warn("🦙 Accel: Unknown operation %d\n", req->op);
         break;
@@ -202,85 +600,291 @@ static void llama_process_request(struct llama_compute_request *req) {
 /*
  * Submit compute request
  */
-int llama_accel_submit(struct llama_compute_request *req) {
-    struct llama_compute_thread *thread;
-    unsigned long flags;
-    int cpu;
+static int __llama_accel_submit(struct llama_compute_request *req) {
+    struct llama_compute_thread *thread = NULL;
+    int n, first;
     
-    if (!llama_accel || !llama_accel->initialized)
+    if (!llama_accel->initialized)
         return -ENODEV;
     
     req->submit_time = ktime_get_ns();
+    atomic_inc(&llama_accel->pending_requests);
+    atomic64_inc(&llama_accel->total_requests);
     
-    /* Round-robin scheduling across compute threads */
-    cpu = atomic_inc_return(&llama_accel->pending_requests) % 
-          llama_accel->nr_compute_threads;
-    thread = &llama_accel->threads[cpu];
+    /* Round-robin across compute threads, skipping full rings */
+    n = llama_accel->nr_compute_threads;
+    first = (unsigned int)atomic_inc_return(&llama_accel->next_thread) % n;
+    for (int i = 0; i < n; i++) {
+        if (llama_ring_push(llama_accel->threads[(first + i) % n].ring, req)) {
+            thread = &llama_accel->threads[(first + i) % n];
+            break;
+        }
+    }
     
-    /* Add to thread's work queue - store request pointer in list entry */
-    spin_lock_irqsave(&thread->work_lock, flags);
-    list_add_tail((struct list_head *)req, &thread->work_list);
-    spin_unlock_irqrestore(&thread->work_lock, flags);
+    /* Every ring full - run it here rather than block the submitter */
+    if (!thread) {
+        atomic64_inc(&llama_accel->inline_requests);
+        llama_accel_run_request(req);
+        return 0;
+    }
     
-    /* Wake up the thread */
-    wake_up(&thread->work_wait);
+    /* Only pay for a wakeup when the owner is asleep; otherwise nudge an idle sibling to steal */
+    if (wq_has_sleeper(&thread->work_wait)) {
+        wake_up(&thread->work_wait);
+        return 0;
+    }
+    for (int i = 1; i < n; i++) {
+        struct llama_compute_thread *idle = &llama_accel->threads[(thread->index + i) % n];
+        
+        if (wq_has_sleeper(&idle->work_wait)) {
+            wake_up(&idle->work_wait);
+            break;
+        }
+    }
     
     return 0;
 }
 
+/* Thread set is stable while resize_sem is held for reading */
+int llama_accel_submit(struct llama_compute_request *req) {
+    int ret;
+    
+    if (!llama_accel || !llama_accel->initialized)
+        return -ENODEV;
+    
+    percpu_down_read(&llama_accel->resize_sem);
+    ret = __llama_accel_submit(req);
+    percpu_up_read(&llama_accel->resize_sem);
+    
+    return ret;
+}
+
+/* Compute threads must not block on work queued behind themselves */
+static bool llama_accel_in_compute_thread(void) {
+    for (int i = 0; i < llama_accel->nr_compute_threads; i++) {
+        if (llama_accel->threads[i].task == current)
+            return true;
+    }
+    return false;
+}
+
 /*
- * Optimized matrix multiplication for Q4_K
+ * Parallel for over the compute threads
  */
-void llama_accel_matmul_q4k(const void *A, const float *B,
-                            float *C, int M, int N, int K) {
-    const int nb = K / QK_K;
-    const int TILE_SIZE = 32;  /* Renamed to avoid conflict */
-    int i, j;
-    
-    /* Process in blocks for better cache usage */
-    for (i = 0; i < M; i += TILE_SIZE) {
-        for (j = 0; j < N; j += TILE_SIZE) {
-            int bi, bj;
-            
-            /* Process block */
-            for (bi = i; bi < min(i + TILE_SIZE, M); bi++) {
-                const struct block_q4_K *row = 
-                    (const struct block_q4_K *)A + bi * nb;
-                
-                for (bj = j; bj < min(j + TILE_SIZE, N); bj++) {
-                    const float *col = B + bj * K;
-                    float sum = 0.0f;
-                    int k;
-                    
-                    /* Optimized dot product */
-                    for (k = 0; k < nb; k++) {
-                        const struct block_q4_K *block = &row[k];
-                        const float *b = col + k * QK_K;
-                        int l;
-                        
-                        /* Dequantize and compute */
-                        for (l = 0; l < QK_K/2; l++) {
-                            uint8_t byte = block->qs[l];
-                            float v0 = (float)((byte & 0xF) - 8) * block->d;
-                            float v1 = (float)(((byte >> 4) & 0xF) - 8) * block->d;
-                            
-                            sum += v0 * b[l*2];
-                            sum += v1 * b[l*2 + 1];
-                        }
-                    }
-                    
-                    C[bi * N + bj] = sum;
-                }
-            }
+int llama_accel_parallel_workers(void) {
+    return 1 + (llama_accel && llama_accel->initialized ?
+                READ_ONCE(llama_accel->nr_compute_threads) : 0);
+}
+
+int llama_accel_parallel_for(long n, long grain, int max_workers,
+                             llama_parallel_fn fn, void *ctx) {
+    struct llama_task_group local, *tg = NULL;
+    bool locked = false;
+    long n_chunks;
+    int n_helpers, ret;
+    
+    if (n <= 0)
+        return 0;
+    
+    /* One helper per compute thread, but never more than there are spare chunks */
+    grain = max(grain, 1L);
+    n_chunks = DIV_ROUND_UP(n, grain);
+    n_helpers = 0;
+    if (llama_accel && llama_accel->initialized) {
+        /* Held until running helpers finish - the thread set can't change under them */
+        percpu_down_read(&llama_accel->resize_sem);
+        locked = true;
+        if (llama_accel->initialized && !llama_accel_in_compute_thread())
+            n_helpers = min3(llama_accel->nr_compute_threads, max_workers - 1,
+                             (int)min_t(long, n_chunks - 1, INT_MAX));
+    }
+    
+    /* Without memory for the helpers the caller does it all */
+    if (n_helpers)
+        tg = kmalloc(struct_size(tg, reqs, n_helpers), GFP_KERNEL);
+    if (!tg) {
+        tg = &local;
+        n_helpers = 0;
+    }
+    
+    tg->fn = fn;
+    tg->ctx = ctx;
+    tg->n = n;
+    tg->grain = grain;
+    atomic_long_set(&tg->next, 0);
+    atomic_set(&tg->error, 0);
+    atomic_set(&tg->active, 1);
+    atomic_set(&tg->workers, 0);
+    refcount_set(&tg->refs, n_helpers + 1);
+    init_completion(&tg->done);
+    
+    for (int i = 0; i < n_helpers; i++) {
+        tg->reqs[i] = (struct llama_compute_request) {
+            .op = LLAMA_OP_PARALLEL_FOR,
+            .complete = llama_task_group_helper_done,
+            .context = tg,
+        };
+        if (__llama_accel_submit(&tg->reqs[i]) < 0)
+            llama_task_group_put(tg);
+    }
+    
+    /*
+     * The caller works too, then waits only for helpers still inside a
+     * chunk; ones that haven't started find the group closed and skip it
+     */
+    llama_task_group_run(tg, 0);
+    if (!atomic_dec_and_test(&tg->active))
+        wait_for_completion(&tg->done);
+    ret = atomic_read(&tg->error);
+    
+    if (locked)
+        percpu_up_read(&llama_accel->resize_sem);
+    
+    if (tg != &local)
+        llama_task_group_put(tg);
+    return ret;
+}
+
+/*
+ * LLC prefetch
+ */
+#define LLAMA_PREFETCH_CHUNK (256 * 1024)
+
+/* prefetcht2: into the LLC, not this core's L1/L2 */
+static void llama_prefetch_range(const void *addr, size_t len) {
+    const char *p = (const char *)((unsigned long)addr & ~(L1_CACHE_BYTES - 1UL));
+    const char *end = (const char *)addr + len;
+    
+    while (p < end) {
+        const char *stop = min(p + LLAMA_PREFETCH_CHUNK, end);
+        
+        for (; p < stop; p += L1_CACHE_BYTES)
+            __builtin_prefetch(p, 0, 1);
+        cond_resched();
+    }
+}
+
+static void llama_prefetch_done(struct llama_compute_request *req) {
+    kfree(req);
+}
+
+/* Queue background work for whichever thread runs dry first */
+static int __llama_accel_submit_idle(struct llama_compute_request *req) {
+    if (!llama_accel->initialized)
+        return -ENODEV;
+    
+    req->submit_time = ktime_get_ns();
+    atomic_inc(&llama_accel->pending_requests);
+    
+    /* Background work is optional - drop it rather than run it here */
+    if (!llama_ring_push(llama_accel->idle_ring, req)) {
+        atomic_dec(&llama_accel->pending_requests);
+        return -EBUSY;
+    }
+    atomic64_inc(&llama_accel->total_requests);
+    
+    for (int i = 0; i < llama_accel->nr_compute_threads; i++) {
+        struct llama_compute_thread *idle = &llama_accel->threads[i];
+        
+        if (wq_has_sleeper(&idle->work_wait)) {
+            wake_up(&idle->work_wait);
+            break;
         }
     }
+    
+    return 0;
+}
+
+int llama_accel_prefetch(const void *addr, size_t len) {
+    struct llama_compute_request *req;
+    int ret;
+    
+    if (!llama_accel || !llama_accel->initialized)
+        return -ENODEV;
+    
+    req = kzalloc(sizeof(*req), GFP_KERNEL);
+    if (!req)
+        return -ENOMEM;
+    
+    req->op = LLAMA_OP_PREFETCH;
+    req->src0 = (void *)addr;
+    req->m = len;
+    req->complete = llama_prefetch_done;
+    
+    percpu_down_read(&llama_accel->resize_sem);
+    ret = __llama_accel_submit_idle(req);
+    percpu_up_read(&llama_accel->resize_sem);
+    
+    if (ret)
+        kfree(req);
+    return ret;
+}
+
+/*
+ * Telemetry
+ */
+static const char * const llama_accel_op_names[LLAMA_OP_COUNT] = {
+    [LLAMA_OP_ATTENTION]    = "attention",
+    [LLAMA_OP_LAYERNORM]    = "layernorm",
+    [LLAMA_OP_SOFTMAX]      = "softmax",
+    [LLAMA_OP_ROPE]         = "rope",
+    [LLAMA_OP_PARALLEL_FOR] = "parallel_for",
+    [LLAMA_OP_PREFETCH]     = "prefetch",
+};
+
+const char *llama_accel_op_name(enum llama_compute_op op) {
+    return op < LLAMA_OP_COUNT ? llama_accel_op_names[op] : "unknown";
+}
+
+int llama_accel_get_stats(struct llama_accel_stats *stats) {
+    const u64 now = ktime_get_ns();
+    
+    memset(stats, 0, sizeof(*stats));
+    if (!llama_accel || !llama_accel->initialized)
+        return -ENODEV;
+    
+    percpu_down_read(&llama_accel->resize_sem);
+    if (!llama_accel->initialized) {
+        percpu_up_read(&llama_accel->resize_sem);
+        return -ENODEV;
+    }
+    stats->nr_threads = llama_accel->nr_compute_threads;
+    stats->pending = atomic_read(&llama_accel->pending_requests);
+    stats->total_requests = atomic64_read(&llama_accel->total_requests);
+    stats->inline_requests = atomic64_read(&llama_accel->inline_requests);
+    stats->total_compute_ns = atomic64_read(&llama_accel->total_compute_ns);
+    
+    for (int i = 0; i < stats->nr_threads; i++) {
+        struct llama_compute_thread *thread = &llama_accel->threads[i];
+        struct llama_accel_thread_stats *ts = &stats->threads[i];
+        
+        ts->cpu = thread->cpu_id;
+        ts->uptime_ns = now - thread->start_ns;
+        ts->busy_ns = atomic64_read(&thread->busy_ns);
+        ts->spin_ns = atomic64_read(&thread->spin_time_ns);
+        ts->processed = atomic64_read(&thread->requests_processed);
+        ts->stolen = atomic64_read(&thread->requests_stolen);
+        ts->spin_wakeups = atomic64_read(&thread->spin_wakeups);
+        ts->sleeps = atomic64_read(&thread->sleeps);
+        ts->queue_depth = atomic_long_read(&thread->ring->tail) -
+                          atomic_long_read(&thread->ring->head);
+    }
+    percpu_up_read(&llama_accel->resize_sem);
+    
+    for (int op = 0; op < LLAMA_OP_COUNT; op++) {
+        stats->ops[op].count = atomic64_read(&llama_accel->op_stats[op].count);
+        stats->ops[op].run_ns = atomic64_read(&llama_accel->op_stats[op].run_ns);
+        stats->ops[op].wait_ns = atomic64_read(&llama_accel->op_stats[op].wait_ns);
+    }
+    
+    return 0;
 }
 
 /*
  * Initialize acceleration engine
  */
 int llama_accel_init(const cpumask_t *compute_cpus) {
-    int cpu, ret = 0;
+    int ret = 0;
     
     if (llama_accel) {
         pr_warn("🦙 Accel: Already initialized\n");
@@ -294,34 +898,21 @@ int llama_accel_init(const cpumask_t *compute_cpus) {
     mutex_init(&llama_accel->init_lock);
     cpumask_copy(&llama_accel->compute_cpus, compute_cpus);
     
-    /* Create memory pools */
-    llama_accel->weight_pool = llama_mem_pool_create(8UL * 1024 * 1024 * 1024,
-                                                     "weights");
-    if (!llama_accel->weight_pool) {
-        ret = -ENOMEM;
+    ret = percpu_init_rwsem(&llama_accel->resize_sem);
+    if (ret)
         goto err_free;
-    }
     
-    llama_accel->activation_pool = llama_mem_pool_create(2UL * 1024 * 1024 * 1024,
-                                                         "activations");
-    if (!llama_accel->activation_pool) {
+    /* Shared by every thread set, so not tied to one CPU's node */
+    llama_accel->idle_ring = llama_ring_create(NUMA_NO_NODE);
+    if (!llama_accel->idle_ring) {
         ret = -ENOMEM;
-        goto err_free_weight;
+        goto err_free_rwsem;
     }
     
     /* Create compute threads */
-    llama_accel->nr_compute_threads = 0;
-    for_each_cpu(cpu, compute_cpus) {
-        if (llama_accel->nr_compute_threads >= MAX_COMPUTE_THREADS)
-            break;
-        
-        ret = llama_setup_compute_thread(
-            &llama_accel->threads[llama_accel->nr_compute_threads], cpu);
-        if (ret)
-            goto err_stop_threads;
-        
-        llama_accel->nr_compute_threads++;
-    }
+    ret = llama_accel_start_threads(compute_cpus);
+    if (ret)
+        goto err_stop_threads;
     
     /* Create submit workqueue */
     llama_accel->submit_wq = alloc_workqueue("llama_submit",
@@ -340,13 +931,10 @@ int llama_accel_init(const cpumask_t *compute_cpus) {
     return 0;
     
 err_stop_threads:
-    for (cpu = 0; cpu < llama_accel->nr_compute_threads; cpu++) {
-        if (llama_accel->threads[cpu].task)
-            kthread_stop(llama_accel->threads[cpu].task);
-    }
-    llama_mem_pool_destroy(llama_accel->activation_pool);
-err_free_weight:
-    llama_mem_pool_destroy(llama_accel->weight_pool);
+    llama_accel_stop_threads();
+    kfree(llama_accel->idle_ring);
+err_free_rwsem:
+    percpu_free_rwsem(&llama_accel->resize_sem);
 err_free:
     kfree(llama_accel);
     llama_accel = NULL;
@@ -356,28 +944,29 @@ err_free:
 /*
  * Cleanup acceleration engine
  */
+/* Callers must not start new work; ones still inside submit or parallel_for are waited for */
 void llama_accel_cleanup(void) {
-    int i;
-    
     if (!llama_accel)
         return;
     
+    mutex_lock(&llama_accel->init_lock);
+    
+    /* Same as llama_accel_set_cpus(): wait for in-flight readers of the thread set */
+    percpu_down_write(&llama_accel->resize_sem);
     llama_accel->initialized = false;
     
     /* Stop all compute threads */
-    for (i = 0; i < llama_accel->nr_compute_threads; i++) {
-        if (llama_accel->threads[i].task)
-            kthread_stop(llama_accel->threads[i].task);
-    }
+    llama_accel_stop_threads();
+    
+    percpu_up_write(&llama_accel->resize_sem);
+    mutex_unlock(&llama_accel->init_lock);
+    percpu_free_rwsem(&llama_accel->resize_sem);
     
     /* Destroy workqueue */
     if (llama_accel->submit_wq)
         destroy_workqueue(llama_accel->submit_wq);
     
-    /* Free memory pools */
-    llama_mem_pool_destroy(llama_accel->weight_pool);
-    llama_mem_pool_destroy(llama_accel->activation_pool);
-    
+    kfree(llama_accel->idle_ring);
     kfree(llama_accel);
     llama_accel = NULL;
     
@@ -385,28 +974,247 @@ void llama_accel_cleanup(void) {
 }
 
 /*
- * Memory allocation from pools
+ * Compute CPU selection
  */
-void *llama_accel_alloc(size_t size, bool is_weight) {
-    struct llama_mem_pool *pool;
-    void *ptr = NULL;
+
+/* "auto" or a cpulist such as "2-5,8"; writing it at runtime rebuilds the threads */
+static char compute_cpus_str[128] = "auto";
+static struct kparam_string compute_cpus_kps = {
+    .maxlen = sizeof(compute_cpus_str),
+    .string = compute_cpus_str,
+};
+
+/* Most compute threads to run, 0 = one per selected CPU */
+static int compute_threads;
+
+static int llama_accel_reconfigure(void);
+
+static int compute_cpus_param_set(const char *val, const struct kernel_param *kp) {
+    cpumask_var_t mask;
+    int ret;
     
-    if (!llama_accel || !llama_accel->initialized)
-        return NULL;
+    /* Reject bad lists before they replace a good one */
+    if (!sysfs_streq(val, "auto")) {
+        if (!alloc_cpumask_var(&mask, GFP_KERNEL))
+            return -ENOMEM;
+        ret = cpulist_parse(val, mask);
+        free_cpumask_var(mask);
+        if (ret)
+            return ret;
+    }
     
-    pool = is_weight ? llama_accel->weight_pool : llama_accel->activation_pool;
+    ret = param_set_copystring(val, kp);
+    if (ret)
+        return ret;
+    strim(compute_cpus_str);
     
-    mutex_lock(&pool->lock);
-    if (pool->used + size <= pool->size) {
-        ptr = pool->base_addr + pool->used;
-        pool->used += ALIGN(size, 64);  /* 64-byte alignment */
+    return llama_accel_reconfigure();
+}
+
+static const struct kernel_param_ops compute_cpus_param_ops = {
+    .set = compute_cpus_param_set,
+    .get = param_get_string,
+};
+module_param_cb(compute_cpus, &compute_cpus_param_ops, &compute_cpus_kps, 0644);
+MODULE_PARM_DESC(compute_cpus, "Compute CPUs: auto (one thread per core, LLC-local, not CPU 0) or a cpulist");
+
+static int compute_threads_param_set(const char *val, const struct kernel_param *kp) {
+    int ret = param_set_int(val, kp);
+    
+    if (ret)
+        return ret;
+    if (compute_threads < 0 || compute_threads > MAX_COMPUTE_THREADS)
+        compute_threads = 0;
+    
+    return llama_accel_reconfigure();
+}
+
+static const struct kernel_param_ops compute_threads_param_ops = {
+    .set = compute_threads_param_set,
+    .get = param_get_int,
+};
+module_param_cb(compute_threads, &compute_threads_param_ops, &compute_threads, 0644);
+MODULE_PARM_DESC(compute_threads, "Max compute threads (0=one per selected CPU, up to 16)");
+
+/*
+ * Auto mode: one hardware thread per physical core so SMT siblings don't
+ * split a core's FMA units, skipping CPU 0's core (housekeeping, IRQs),
+ * filling from the LLC domain with the most free cores first so matmul
+ * chunks share the same L3.
+ */
+static void llama_accel_auto_cpus(struct cpumask *cpus, int wanted) {
+    cpumask_var_t cores, llc;
+    int cpu;
+    
+    cpumask_clear(cpus);
+    if (!zalloc_cpumask_var(&cores, GFP_KERNEL))
+        return;
+    if (!zalloc_cpumask_var(&llc, GFP_KERNEL)) {
+        free_cpumask_var(cores);
+        return;
     }
-    mutex_unlock(&pool->lock);
     
-    return ptr;
+    for_each_online_cpu(cpu) {
+        if (cpumask_test_cpu(0, topology_sibling_cpumask(cpu)) && num_online_cpus() > 1)
+            continue;
+        if (cpumask_intersects(topology_sibling_cpumask(cpu), cores))
+            continue;
+        cpumask_set_cpu(cpu, cores);
+    }
+    
+    while (cpumask_weight(cpus) < wanted && !cpumask_empty(cores)) {
+        int best = cpumask_first(cores), best_n = 0;
+        
+        for_each_cpu(cpu, cores) {
+            int n = cpumask_weight_and(cpu_llc_shared_mask(cpu), cores);
+            
+            if (n > best_n) {
+                best = cpu;
+                best_n = n;
+            }
+        }
+        
+        cpumask_and(llc, cpu_llc_shared_mask(best), cores);
+        cpumask_set_cpu(best, llc);
+        for_each_cpu(cpu, llc) {
+            if (cpumask_weight(cpus) >= wanted)
+                break;
+            cpumask_set_cpu(cpu, cpus);
+        }
+        cpumask_andnot(cores, cores, llc);
+    }
+    
+    free_cpumask_var(llc);
+    free_cpumask_var(cores);
+}
+
+/* Resolve the compute_cpus / compute_threads parameters to a CPU set */
+int llama_accel_select_cpus(struct cpumask *cpus) {
+    const int wanted = compute_threads ? compute_threads : MAX_COMPUTE_THREADS;
+    int ret, cpu, n = 0;
+    
+    if (sysfs_streq(compute_cpus_str, "auto")) {
+        llama_accel_auto_cpus(cpus, wanted);
+    } else {
+        ret = cpulist_parse(compute_cpus_str, cpus);
+        if (ret)
+            return ret;
+        cpumask_and(cpus, cpus, cpu_online_mask);
+        
+        /* Keep the first 'wanted' of the listed CPUs */
+        for_each_cpu(cpu, cpus) {
+            if (++n > wanted)
+                cpumask_clear_cpu(cpu, cpus);
+        }
+    }
+    
+    /* Uniprocessor, or every listed CPU offline */
+    if (cpumask_empty(cpus))
+        cpumask_set_cpu(cpumask_first(cpu_online_mask), cpus);
+    
+    return 0;
+}
+
+/* Tear the compute threads down and start them again on a new CPU set */
+int llama_accel_set_cpus(const struct cpumask *cpus) {
+    int ret;
+    
+    if (!llama_accel)
+        return -ENODEV;
+    
+    mutex_lock(&llama_accel->init_lock);
+    
+    /* Waits for in-flight parallel_for and submit calls */
+    percpu_down_write(&llama_accel->resize_sem);
+    
+    llama_accel_stop_threads();
+    cpumask_copy(&llama_accel->compute_cpus, cpus);
+    ret = llama_accel_start_threads(cpus);
+    if (ret) {
+        llama_accel_stop_threads();
+        llama_accel->initialized = false;
+        pr_err("🦙 Accel: Failed to restart compute threads (%d), running without\n", ret);
+    } else {
+        llama_accel->initialized = true;
+        workqueue_set_max_active(llama_accel->submit_wq, llama_accel->nr_compute_threads);
+        pr_info("🦙 Accel: Now %d compute threads on CPUs %*pbl\n",
+                llama_accel->nr_compute_threads, cpumask_pr_args(cpus));
+    }
+    
+    percpu_up_write(&llama_accel->resize_sem);
+    mutex_unlock(&llama_accel->init_lock);
+    
+    return ret;
+}
+
+/* Parameter write - apply it if the engine is already running */
+static int llama_accel_reconfigure(void) {
+    cpumask_var_t cpus;
+    int ret;
+    
+    if (!llama_accel)
+        return 0;
+    
+    if (!alloc_cpumask_var(&cpus, GFP_KERNEL))
+        return -ENOMEM;
+    
+    ret = llama_accel_select_cpus(cpus);
+    if (!ret)
+        ret = llama_accel_set_cpus(cpus);
+    
+    free_cpumask_var(cpus);
+    return ret;
+}
+
+/*
+ * Memory allocation from pools
+ */
+int llama_accel_pools_init(size_t weight_bytes, size_t activation_bytes) {
+    if (llama_weight_pool || llama_activation_pool)
+        return -EEXIST;
+    
+    /* No weight pool when the weights are mapped from elsewhere */
+    if (weight_bytes) {
+        llama_weight_pool = llama_mem_pool_create(weight_bytes, "weights");
+        if (!llama_weight_pool)
+            return -ENOMEM;
+    }
+    
+    llama_activation_pool = llama_mem_pool_create(activation_bytes, "activations");
+    if (!llama_activation_pool) {
+        llama_mem_pool_destroy(llama_weight_pool);
+        llama_weight_pool = NULL;
+        return -ENOMEM;
+    }
+    
+    return 0;
+}
+
+void llama_accel_pools_free(void) {
+    llama_mem_pool_destroy(llama_activation_pool);
+    llama_activation_pool = NULL;
+    llama_mem_pool_destroy(llama_weight_pool);
+    llama_weight_pool = NULL;
+}
+
+void *llama_accel_alloc(size_t size, bool is_weight) {
+    struct llama_mem_pool *pool = is_weight ? llama_weight_pool : llama_activation_pool;
+    
+    if (!pool)
+        return NULL;
+    
+    /* Large buffers start on a page boundary */
+    return llama_mem_pool_alloc(pool, size, size >= PAGE_SIZE ? PAGE_SIZE : LLAMA_POOL_ALIGN);
 }
 
 void llama_accel_free(void *ptr) {
-    /* Pool allocations are not individually freed */
-    /* They're freed when the pool is destroyed */
+    if (!ptr)
+        return;
+    
+    if (llama_mem_pool_contains(llama_weight_pool, ptr))
+        llama_mem_pool_free(llama_weight_pool, ptr);
+    else if (llama_mem_pool_contains(llama_activation_pool, ptr))
+        llama_mem_pool_free(llama_activation_pool, ptr);
+    else
+        pr_warn("🦙 Accel: Freeing %p outside the pools\n", ptr);
 }
\ No newline at end of file
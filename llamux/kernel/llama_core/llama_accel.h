@@ -15,18 +15,21 @@
 #include <linux/ring_buffer.h>
 #include <linux/huge_mm.h>
 #include <linux/dma-mapping.h>
+#include <linux/percpu-rwsem.h>
 
 #define MAX_COMPUTE_THREADS 16
-#define COMPUTE_RING_SIZE 1024
-#define HUGE_PAGE_SIZE (1UL << 30)  /* 1GB huge pages */
+#define COMPUTE_RING_SIZE 1024     /* Power of two */
+#define LLAMA_POOL_ALIGN 64         /* Minimum pool allocation alignment */
 
 /* Compute request types */
 enum llama_compute_op {
-    LLAMA_OP_MATMUL_Q4K,
     LLAMA_OP_ATTENTION,
     LLAMA_OP_LAYERNORM,
     LLAMA_OP_SOFTMAX,
     LLAMA_OP_ROPE,
+    LLAMA_OP_PARALLEL_FOR,      /* Helper for llama_accel_parallel_for() */
+    LLAMA_OP_PREFETCH,          /* Pull src0[0, m) into the LLC */
+    LLAMA_OP_COUNT,
 };
 
 /* Compute request structure */
@@ -46,31 +49,75 @@ struct llama_compute_request {
     u64 complete_time;
 };
 
-/* Memory pool for huge pages */
+/* A free or allocated range of a pool */
+struct llama_mem_extent {
+    struct list_head list;
+    size_t offset;              /* Start of the range in the pool */
+    size_t size;
+    void *ptr;                  /* Aligned address handed out, allocated only */
+};
+
+/*
+ * Memory pool backed by one vmalloc_huge() area, so large tensors are
+ * mapped with PMD-sized pages. Ranges are handed out first-fit from an
+ * address-ordered free list and coalesce with their neighbours on free.
+ */
 struct llama_mem_pool {
     void *base_addr;
     size_t size;
     size_t used;
+    const char *name;
     struct mutex lock;
-    
-    /* Huge page info */
-    int nr_hugepages;
-    struct page **pages;
+    struct list_head free_list; /* By offset */
+    struct list_head used_list;
+};
+
+/*
+ * Bounded lock-free request ring. Each slot carries a sequence number
+ * telling producers and consumers whose turn it is, so a push or pop is
+ * one cmpxchg on tail or head: the owning thread pops from its own ring
+ * and idle siblings steal from it the same way, without a lock.
+ */
+struct llama_ring_slot {
+    atomic_long_t seq;
+    struct llama_compute_request *req;
+};
+
+struct llama_compute_ring {
+    atomic_long_t tail ____cacheline_aligned;  /* Next slot to fill */
+    atomic_long_t head ____cacheline_aligned;  /* Next slot to take */
+    struct llama_ring_slot slots[COMPUTE_RING_SIZE] ____cacheline_aligned;
 };
 
 /* Per-CPU compute thread data */
 struct llama_compute_thread {
     struct task_struct *task;
     int cpu_id;
+    int index;                  /* Position in llama_accel->threads */
     
-    /* Local work queue */
-    struct list_head work_list;
-    spinlock_t work_lock;
+    /* Local work queue - submitters push, owner and thieves pop */
+    struct llama_compute_ring *ring;
     wait_queue_head_t work_wait;
     
+    /* Spin-then-sleep state, owned by the thread */
+    u64 avg_gap_ns;             /* EWMA of idle gaps between bursts */
+    u64 spin_ns;                /* Current poll window, 0 = sleep at once */
+    
     /* Statistics */
+    u64 start_ns;               /* When the thread was set up */
     atomic64_t requests_processed;
-    atomic64_t total_cycles;
+    atomic64_t requests_stolen;
+    atomic64_t spin_wakeups;    /* Work found while polling */
+    atomic64_t sleeps;
+    atomic64_t busy_ns;         /* Running requests */
+    atomic64_t spin_time_ns;    /* Polling for work */
+};
+
+/* Per-op totals, indexed by enum llama_compute_op */
+struct llama_accel_op_stats {
+    atomic64_t count;
+    atomic64_t run_ns;          /* Time spent running */
+    atomic64_t wait_ns;         /* Time queued, submit to start */
 };
 
 /* Main acceleration engine */
@@ -85,22 +132,23 @@ struct llama_accel_engine {
     
     /* Global request queue */
     struct workqueue_struct *submit_wq;
-    atomic_t pending_requests;
-    
-    /* Memory pools */
-    struct llama_mem_pool *weight_pool;
-    struct llama_mem_pool *activation_pool;
+    atomic_t pending_requests;  /* Submitted, not yet completed */
+    atomic_t next_thread;       /* Round-robin submit cursor */
+    struct llama_compute_ring *idle_ring;  /* Background work, taken when every ring is empty */
     
     /* DMA engine (optional) */
     struct dma_chan *dma_chan;
     
     /* Performance monitoring */
     atomic64_t total_requests;
-    atomic64_t total_compute_cycles;
+    atomic64_t inline_requests; /* Run by the submitter, every ring full */
+    atomic64_t total_compute_ns;
+    struct llama_accel_op_stats op_stats[LLAMA_OP_COUNT];
     
     /* Engine state */
     bool initialized;
-    struct mutex init_lock;
+    struct mutex init_lock;     /* Serializes thread set changes */
+    struct percpu_rw_semaphore resize_sem;  /* Read: using threads[], write: replacing them */
 };
 
 /* Global acceleration engine instance */
@@ -110,10 +158,53 @@ extern struct llama_accel_engine *llama_accel;
 int llama_accel_init(const cpumask_t *compute_cpus);
 void llama_accel_cleanup(void);
 
+/* Compute CPUs from the compute_cpus / compute_threads module parameters */
+int llama_accel_select_cpus(struct cpumask *cpus);
+
+/* Replace the compute threads with one per CPU in cpus */
+int llama_accel_set_cpus(const struct cpumask *cpus);
+
 /* Submit compute request */
 int llama_accel_submit(struct llama_compute_request *req);
 
-/* Memory allocation from huge page pools */
+/*
+ * Run fn over [0, n) in chunks of at most grain, on the compute threads
+ * and the calling thread. Chunks are claimed dynamically, so uneven
+ * chunks balance out. Returns once every claimed chunk has finished,
+ * without waiting for helpers that never got to start, with the first
+ * negative value fn returned (no further chunks start after an error),
+ * or 0. fn runs in process context and must open its
+ * own FPU region. Called from a compute thread, it runs inline.
+ *
+ * fn gets the index of the worker running it, below max_workers (the
+ * caller is 0), for per-worker scratch sized once per call.
+ * llama_accel_parallel_workers() is the most workers a call can use.
+ */
+typedef int (*llama_parallel_fn)(void *ctx, int worker, long start, long end);
+
+int llama_accel_parallel_workers(void);
+int llama_accel_parallel_for(long n, long grain, int max_workers,
+                             llama_parallel_fn fn, void *ctx);
+
+/*
+ * Stream [addr, addr + len) into the last-level cache from a compute
+ * thread, without waiting. It runs only once the threads have no other
+ * work queued. Prefetches never fault, so the range may go away
+ * meanwhile. -ENODEV without compute threads, -EBUSY when too many
+ * prefetches are already queued.
+ */
+int llama_accel_prefetch(const void *addr, size_t len);
+
+/*
+ * Huge-page memory pools for model weights and the GGML context
+ * (activations, KV cache). They are sized at model load from what the
+ * model needs and do not depend on the compute threads. weight_bytes
+ * may be 0 when the weights live outside the pools.
+ */
+int llama_accel_pools_init(size_t weight_bytes, size_t activation_bytes);
+void llama_accel_pools_free(void);
+
+/* Allocation from the pools - NULL when the pool is missing or full */
 void *llama_accel_alloc(size_t size, bool is_weight);
 void llama_accel_free(void *ptr);
 
@@ -121,12 +212,37 @@ void llama_accel_free(void *ptr);
 int llama_accel_isolate_cpus(const cpumask_t *cpus);
 int llama_accel_release_cpus(const cpumask_t *cpus);
 
-/* Performance monitoring */
-void llama_accel_get_stats(struct llama_accel_stats *stats);
+/* Performance monitoring - a snapshot of the engine counters */
+struct llama_accel_thread_stats {
+    int cpu;
+    u64 uptime_ns;
+    u64 busy_ns;
+    u64 spin_ns;
+    u64 processed;
+    u64 stolen;
+    u64 spin_wakeups;
+    u64 sleeps;
+    long queue_depth;
+};
+
+struct llama_accel_stats {
+    int nr_threads;
+    int pending;
+    u64 total_requests;
+    u64 inline_requests;
+    u64 total_compute_ns;
+    struct llama_accel_thread_stats threads[MAX_COMPUTE_THREADS];
+    struct {
+        u64 count;
+        u64 run_ns;
+        u64 wait_ns;
+    } ops[LLAMA_OP_COUNT];
+};
+
+int llama_accel_get_stats(struct llama_accel_stats *stats);
+const char *llama_accel_op_name(enum llama_compute_op op);
 
 /* Optimized compute operations */
-void llama_accel_matmul_q4k(const void *A, const float *B, 
-                            float *C, int M, int N, int K);
 void llama_accel_attention(const float *Q, const float *K,
                           const float *V, float *out, 
                           int seq_len, int d_head);
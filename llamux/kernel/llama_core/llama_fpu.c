@@ -0,0 +1,47 @@
+/*
+ * Scoped FPU regions for Llamux - see llama_fpu.h
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <asm/fpu/api.h>
+#include "llama_fpu.h"
+
+/* Longest a region may keep preemption off before yielding */
+static uint fpu_budget_us = 500;
+module_param(fpu_budget_us, uint, 0644);
+MODULE_PARM_DESC(fpu_budget_us, "Max microseconds per FPU region before yielding (0=every checkpoint)");
+
+static inline void llama_fpu_arm(struct llama_fpu_region *r) {
+    r->deadline = local_clock() + (u64)READ_ONCE(fpu_budget_us) * NSEC_PER_USEC;
+}
+
+void llama_fpu_begin(struct llama_fpu_region *r) {
+    if (r->open)
+        return;
+
+    kernel_fpu_begin();
+    r->open = true;
+    llama_fpu_arm(r);
+}
+
+void llama_fpu_end(struct llama_fpu_region *r) {
+    if (!r->open)
+        return;
+
+    kernel_fpu_end();
+    r->open = false;
+}
+
+void llama_fpu_yield(struct llama_fpu_region *r) {
+    if (!r->open) {
+        llama_fpu_arm(r);
+        return;
+    }
+
+    kernel_fpu_end();
+    cond_resched();
+    kernel_fpu_begin();
+    llama_fpu_arm(r);
+}
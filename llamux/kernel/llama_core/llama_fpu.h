@@ -0,0 +1,41 @@
+/*
+ * Scoped FPU regions for Llamux
+ *
+ * kernel_fpu_begin() saves the user FPU state and disables preemption, so
+ * toggling it per row or per block burns XSAVE/XRSTOR cycles, while one
+ * region around a whole matmul can keep the CPU unpreemptible for tens of
+ * milliseconds. A llama_fpu_region sits in between: the caller opens it
+ * once, calls llama_fpu_checkpoint() between work chunks, and the region
+ * is only closed (and the CPU offered to the scheduler) once the time
+ * budget set by the fpu_budget_us module parameter has run out.
+ *
+ * Code running inside a region must not sleep, and must not call
+ * kernel_fpu_begin() itself - the dequantizers in quantize.c expect the
+ * caller to hold a region.
+ */
+
+#ifndef _LLAMUX_LLAMA_FPU_H
+#define _LLAMUX_LLAMA_FPU_H
+
+#include <linux/types.h>
+#include <linux/sched/clock.h>
+
+struct llama_fpu_region {
+    u64 deadline;       /* local_clock() at which to yield */
+    bool open;
+};
+
+/* Open / close a region; both are no-ops if already in that state */
+void llama_fpu_begin(struct llama_fpu_region *r);
+void llama_fpu_end(struct llama_fpu_region *r);
+
+/* Close, cond_resched() and reopen with a fresh budget */
+void llama_fpu_yield(struct llama_fpu_region *r);
+
+/* Call between work chunks - cheap unless the budget has expired */
+static inline void llama_fpu_checkpoint(struct llama_fpu_region *r) {
+    if (unlikely(local_clock() >= r->deadline))
+        llama_fpu_yield(r);
+}
+
+#endif /* _LLAMUX_LLAMA_FPU_H */
@@ -6,7 +6,10 @@
  */
 
 #include <linux/kernel.h>
+#include <linux/module.h>
 #include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
 #include <linux/string.h>
 #include <linux/random.h>
 #include <linux/ktime.h>
@@ -15,6 +18,164 @@
 #include "ggml_kernel.h"
 #include "gguf_parser.h"
 #include "llamux_stats.h"
+#include "quantize.h"
+#include "llama_fpu.h"
+
+/* Load-time requantization of F32/F16 matrices: 0 = off, 1 = Q8_0 */
+static int requant_weights = 0;
+module_param(requant_weights, int, 0444);
+MODULE_PARM_DESC(requant_weights, "Requantize F32/F16 weight matrices in place at load: 0=off, 1=Q8_0");
+
+/* Only matrices with at least this many elements are requantized */
+static ulong requant_min_elems = 1UL << 20;
+module_param(requant_min_elems, ulong, 0444);
+MODULE_PARM_DESC(requant_min_elems, "Smallest matrix (elements) worth requantizing at load");
+
+/* GGML context headroom for per-eval graph tensors, on top of what the model needs */
+static uint ctx_scratch_mb = 4096;
+module_param(ctx_scratch_mb, uint, 0444);
+MODULE_PARM_DESC(ctx_scratch_mb, "GGML context space for activations beyond weights and KV cache (MB)");
+
+/* Placeholder weight type - Q8_0 when requantizing, F32 otherwise */
+static enum ggml_type llama_placeholder_type(void) {
+    return requant_weights == 1 ? GGML_TYPE_Q8_0 : GGML_TYPE_F32;
+}
+
+/*
+ * Convert one F32/F16 matrix to Q8_0 in place. A Q8_0 row is smaller than
+ * its source row, so each row is staged through an F32 buffer and written
+ * back at its new, lower offset without touching rows not yet converted.
+ * Weights mapped from the page cache are read-only and are left alone.
+ */
+static struct ggml_tensor *llama_requantize_q8_0(const struct gguf_model *gguf,
+                                                 struct ggml_tensor *src) {
+    struct llama_fpu_region fpu = { 0 };
+    float *row_buf;
+    const int64_t ne0 = src ? src->ne[0] : 0;
+    const int64_t ne1 = src ? src->ne[1] : 0;
+    const size_t row_bytes = gguf_tensor_size(GGML_TYPE_Q8_0, ne0);
+    size_t src_bytes;
+    
+    if (requant_weights != 1 || !src || !src->data || src->n_dims != 2)
+        return src;
+    if (src->type != GGML_TYPE_F32 && src->type != GGML_TYPE_F16)
+        return src;
+    if (ne0 % QK8_0 != 0 || (u64)ne0 * ne1 < requant_min_elems)
+        return src;
+    if (gguf->data_readonly) {
+        pr_warn_once("🦙 Llama: Weights are mapped read-only, not requantizing\n");
+        return src;
+    }
+    
+    row_buf = kvmalloc(ne0 * sizeof(float), GFP_KERNEL);
+    if (!row_buf) {
+        pr_warn("🦙 Llama: Failed to allocate requant buffer for %s\n", src->name);
+        return src;
+    }
+    
+    src_bytes = ggml_nbytes(src);
+    
+    llama_fpu_begin(&fpu);
+    for (int64_t i = 0; i < ne1; i++) {
+        const void *src_row = (const char *)src->data + i * src->nb[1];
+        struct block_q8_0 *dst_row = (struct block_q8_0 *)((char *)src->data + i * row_bytes);
+        
+        if (src->type == GGML_TYPE_F16)
+            dequantize_f16(src_row, row_buf, ne0);
+        else
+            memcpy(row_buf, src_row, ne0 * sizeof(float));
+        
+        quantize_row_q8_0(row_buf, dst_row, ne0);
+        llama_fpu_checkpoint(&fpu);
+    }
+    llama_fpu_end(&fpu);
+    
+    kvfree(row_buf);
+    
+    /* Same layout gguf_tensor_to_ggml() gives a Q8_0 tensor */
+    src->type = GGML_TYPE_Q8_0;
+    src->nb[0] = ggml_type_size(GGML_TYPE_Q8_0);
+    src->nb[1] = row_bytes;
+    src->nb[2] = src->nb[1] * src->ne[1];
+    src->nb[3] = src->nb[2] * src->ne[2];
+    
+    pr_info("🦙 Llama: Requantized %s in place -> Q8_0 (%zu MB -> %zu MB)\n",
+            src->name, src_bytes / (1024 * 1024), ggml_nbytes(src) / (1024 * 1024));
+    
+    return src;
+}
+
+static void llama_model_tag_weight(struct llama_model *model, struct ggml_tensor *t,
+                                   int layer, enum weight_type type) {
+    llama_weight_cache_tag(t, layer, type);
+    llama_weight_cache_register(model->weight_cache, t);
+}
+
+/*
+ * Tag layer weights with their cache slots so matmuls skip name parsing,
+ * and register them with the cache for warm-up
+ */
+static void llama_model_tag_weights(struct llama_model *model) {
+    for (int i = 0; i < model->hparams.n_layer; i++) {
+        struct llama_layer *layer = &model->layers[i];
+        
+        llama_model_tag_weight(model, layer->wq, i, WEIGHT_WQ);
+        llama_model_tag_weight(model, layer->wk, i, WEIGHT_WK);
+        llama_model_tag_weight(model, layer->wv, i, WEIGHT_WV);
+        llama_model_tag_weight(model, layer->wo, i, WEIGHT_WO);
+        llama_model_tag_weight(model, layer->w1, i, WEIGHT_W1);
+        llama_model_tag_weight(model, layer->w2, i, WEIGHT_W2);
+        llama_model_tag_weight(model, layer->w3, i, WEIGHT_W3);
+    }
+    
+    /* Global tensors live in layer 0's spare slots */
+    if (model->output && model->output != model->tok_embeddings)
+        llama_model_tag_weight(model, model->output, 0, WEIGHT_OUTPUT);
+    
+    /* Embeddings are only read a few rows at a time */
+    if (model->weight_cache && model->tok_embeddings &&
+        model->tok_embeddings->type != GGML_TYPE_F32)
+        llama_weight_cache_register_rows(model->weight_cache, model->tok_embeddings);
+}
+
+/* Create the weight cache and hand it to the GGML matmul kernels */
+static void llama_model_init_weight_cache(struct llama_model *model) {
+    /* Initialize weight cache - 15GB for dequantized weights */
+    model->weight_cache = kzalloc(sizeof(struct llama_weight_cache), GFP_KERNEL);
+    if (model->weight_cache) {
+        size_t cache_size = 15ULL * 1024 * 1024 * 1024; /* 15GB */
+        int ret = llama_weight_cache_init(model->weight_cache, model->hparams.n_layer, cache_size);
+        if (ret < 0) {
+            pr_warn("🦙 Llama: Failed to init weight cache, continuing without it\n");
+            kfree(model->weight_cache);
+            model->weight_cache = NULL;
+        }
+    }
+    
+    /* Set global weight cache for GGML operations */
+    if (model->weight_cache) {
+        extern void ggml_set_weight_cache(struct llama_weight_cache *cache);
+        ggml_set_weight_cache(model->weight_cache);
+    }
+}
+
+/*
+ * Size of the GGML context a model needs: a header per tensor, the KV
+ * cache and activation scratch. Tensor data itself lives in the weight
+ * pool, and is requantized there.
+ */
+size_t llama_model_ctx_size(const struct gguf_model *gguf) {
+    const size_t hdr = ALIGN(sizeof(struct ggml_tensor), GGML_TENSOR_ALIGN);
+    size_t size = ALIGN(sizeof(struct ggml_context), GGML_TENSOR_ALIGN);
+    
+    size += (gguf->tensor_count + 64) * hdr;
+    
+    /* F32 K and V for every layer */
+    size += 2 * ALIGN((size_t)gguf->n_layers * LLAMA_N_CTX * gguf->embedding_length *
+                      sizeof(float), GGML_TENSOR_ALIGN);
+    
+    return size + (size_t)ctx_scratch_mb * 1024 * 1024;
+}
 
 /* Create model structure from GGUF data */
 struct llama_model *llama_model_create_from_gguf(struct ggml_context *ctx, struct gguf_model *gguf) {
@@ -67,6 +228,7 @@ struct llama_model *llama_model_create_from_gguf(struct ggml_context *ctx, struc
             kfree(model);
             return NULL;
         }
+        ggml_set_name(model->tok_embeddings, tok_embd_gguf->name);
         pr_info("🦙 Llama: Token embeddings created: %p, dims: %lld x %lld\n", 
                 model->tok_embeddings, tok_embd_gguf->dims[0], tok_embd_gguf->dims[1]);
         
@@ -110,6 +272,8 @@ struct llama_model *llama_model_create_from_gguf(struct ggml_context *ctx, struc
     
     if (output_gguf) {
         model->output = gguf_tensor_to_ggml(ctx, output_gguf);
+        if (model->output)
+            ggml_set_name(model->output, output_gguf->name);
         pr_info("🦙 Llama: Found output projection tensor: %s\n", output_gguf->name);
     } else {
         /* Many LLaMA models use tied embeddings - output = input embeddings */
@@ -192,10 +356,10 @@ struct llama_model *llama_model_create_from_gguf(struct ggml_context *ctx, struc
             int64_t ne_qkv[4] = {model->hparams.n_embd, model->hparams.n_embd, 1, 1};
             int64_t ne_o[4] = {model->hparams.n_embd, model->hparams.n_embd, 1, 1};
             
-            if (!layer->wq) layer->wq = ggml_new_tensor(ctx, GGML_TYPE_F32, 2, ne_qkv);
-            if (!layer->wk) layer->wk = ggml_new_tensor(ctx, GGML_TYPE_F32, 2, ne_qkv);
-            if (!layer->wv) layer->wv = ggml_new_tensor(ctx, GGML_TYPE_F32, 2, ne_qkv);
-            if (!layer->wo) layer->wo = ggml_new_tensor(ctx, GGML_TYPE_F32, 2, ne_o);
+            if (!layer->wq) layer->wq = ggml_new_tensor(ctx, llama_placeholder_type(), 2, ne_qkv);
+            if (!layer->wk) layer->wk = ggml_new_tensor(ctx, llama_placeholder_type(), 2, ne_qkv);
+            if (!layer->wv) layer->wv = ggml_new_tensor(ctx, llama_placeholder_type(), 2, ne_qkv);
+            if (!layer->wo) layer->wo = ggml_new_tensor(ctx, llama_placeholder_type(), 2, ne_o);
         }
         if (!layer->w1 || !layer->w2 || !layer->w3) {
             pr_warn("🦙 Llama: Missing FFN weights for layer %d, creating placeholders\n", i);
@@ -204,9 +368,9 @@ struct llama_model *llama_model_create_from_gguf(struct ggml_context *ctx, struc
             int64_t ne_w2[4] = {model->hparams.n_ff, model->hparams.n_embd, 1, 1};
             int64_t ne_w3[4] = {model->hparams.n_embd, model->hparams.n_ff, 1, 1};
             
-            if (!layer->w1) layer->w1 = ggml_new_tensor(ctx, GGML_TYPE_F32, 2, ne_w1);
-            if (!layer->w2) layer->w2 = ggml_new_tensor(ctx, GGML_TYPE_F32, 2, ne_w2);
-            if (!layer->w3) layer->w3 = ggml_new_tensor(ctx, GGML_TYPE_F32, 2, ne_w3);
+            if (!layer->w1) layer->w1 = ggml_new_tensor(ctx, llama_placeholder_type(), 2, ne_w1);
+            if (!layer->w2) layer->w2 = ggml_new_tensor(ctx, llama_placeholder_type(), 2, ne_w2);
+            if (!layer->w3) layer->w3 = ggml_new_tensor(ctx, llama_placeholder_type(), 2, ne_w3);
         }
         if (!layer->attention_norm || !layer->ffn_norm) {
             pr_warn("🦙 Llama: Missing norm weights for layer %d, creating placeholders\n", i);
@@ -215,8 +379,26 @@ struct llama_model *llama_model_create_from_gguf(struct ggml_context *ctx, struc
             if (!layer->attention_norm) layer->attention_norm = ggml_new_tensor(ctx, GGML_TYPE_F32, 1, ne_norm);
             if (!layer->ffn_norm) layer->ffn_norm = ggml_new_tensor(ctx, GGML_TYPE_F32, 1, ne_norm);
         }
+        
+        /* Opt-in: shrink F32/F16 matrices to Q8_0 to cut decode bandwidth */
+        layer->wq = llama_requantize_q8_0(gguf, layer->wq);
+        layer->wk = llama_requantize_q8_0(gguf, layer->wk);
+        layer->wv = llama_requantize_q8_0(gguf, layer->wv);
+        layer->wo = llama_requantize_q8_0(gguf, layer->wo);
+        layer->w1 = llama_requantize_q8_0(gguf, layer->w1);
+        layer->w2 = llama_requantize_q8_0(gguf, layer->w2);
+        layer->w3 = llama_requantize_q8_0(gguf, layer->w3);
+    }
+    
+    /* Output projection is the largest matmul per token - unless tied to the embeddings */
+    if (model->output && model->output->n_dims == 2 && model->output != model->tok_embeddings) {
+        model->output = llama_requantize_q8_0(gguf, model->output);
     }
     
+    /* Logits are read once by the sampler - keep them out of the cache */
+    if (model->output)
+        model->output->stream_dst = true;
+    
     /* Initialize tokenizer */
     if (llama_tokenizer_init(&model->tokenizer) != 0) {
         pr_err("🦙 Llama: Failed to initialize tokenizer\n");
@@ -225,6 +407,19 @@ struct llama_model *llama_model_create_from_gguf(struct ggml_context *ctx, struc
         return NULL;
     }
     
+    /*
+     * A full model's weights decoded run to several times its file size,
+     * so a GGUF model only gets a cache (and warm-up) when a budget was
+     * asked for. Tags are still set - prefetch keys layers off them.
+     */
+    if (llama_weight_cache_configured())
+        llama_model_init_weight_cache(model);
+    llama_model_tag_weights(model);
+    
+    /* Decode weights in the background; requests may start meanwhile */
+    if (model->weight_cache)
+        llama_weight_cache_warm(model->weight_cache);
+    
     pr_info("🦙 Llama: Real model created from GGUF - %d layers, %d embd, %d heads\n",
             model->hparams.n_layer, model->hparams.n_embd, model->hparams.n_head);
     
@@ -271,27 +466,11 @@ struct llama_model *llama_model_create(struct ggml_context *ctx) {
         return NULL;
     }
     
-    /* Initialize weight cache - 15GB for dequantized weights */
-    model->weight_cache = kzalloc(sizeof(struct llama_weight_cache), GFP_KERNEL);
-    if (model->weight_cache) {
-        size_t cache_size = 15ULL * 1024 * 1024 * 1024; /* 15GB */
-        int ret = llama_weight_cache_init(model->weight_cache, model->hparams.n_layer, cache_size);
-        if (ret < 0) {
-            pr_warn("🦙 Llama: Failed to init weight cache, continuing without it\n");
-            kfree(model->weight_cache);
-            model->weight_cache = NULL;
-        }
-    }
+    llama_model_init_weight_cache(model);
     
     pr_info("🦙 Llama: Model created - %d layers, %d embd, %d heads\n",
             model->hparams.n_layer, model->hparams.n_embd, model->hparams.n_head);
     
-    /* Set global weight cache for GGML operations */
-    if (model->weight_cache) {
-        extern void ggml_set_weight_cache(struct llama_weight_cache *cache);
-        ggml_set_weight_cache(model->weight_cache);
-    }
-    
     return model;
 }
 
@@ -341,7 +520,7 @@ struct llama_state *llama_state_create(struct llama_model *model) {
     }
     
     /* Initialize KV cache - full context for CodeLlama 13B */
-    const int64_t test_ctx = 2048; /* Full 2K context for code analysis */
+    const int64_t test_ctx = LLAMA_N_CTX; /* Full 2K context for code analysis */
     const int64_t n_mem = model->hparams.n_layer * test_ctx;
     const int64_t n_elements = model->hparams.n_embd * n_mem;
     
@@ -700,10 +879,10 @@ static struct ggml_tensor *llama_layer_forward(
 }
 
 /* Run forward pass */
-int llama_eval(struct llama_state *state,
-               const int32_t *tokens,
-               int n_tokens,
-               int n_past) {
+static int llama_eval_graph(struct llama_state *state,
+                            const int32_t *tokens,
+                            int n_tokens,
+                            int n_past) {
     
     struct llama_model *model = state->model;
     struct ggml_context *ctx = model->ctx;
@@ -743,7 +922,9 @@ int llama_eval(struct llama_state *state,
             pr_info("🦙 Llama: Processing layer %d/%d, nodes: %d\n", 
                     i, model->hparams.n_layer, ctx->n_objects);
         }
+        ggml_set_layer(ctx, i);
         cur = llama_layer_forward(ctx, model, state, cur, i);
+        ggml_set_layer(ctx, -1);
         if (!cur) {
             pr_err("🦙 Llama: Layer %d forward pass failed!\n", i);
             return -EINVAL;
@@ -858,6 +1039,30 @@ int llama_eval(struct llama_state *state,
     return 0;
 }
 
+/*
+ * Evaluate tokens. Graph tensors are scratch: the logits are copied out
+ * and the KV cache is persistent, so everything the graph allocated is
+ * released before returning.
+ */
+int llama_eval(struct llama_state *state,
+               const int32_t *tokens,
+               int n_tokens,
+               int n_past) {
+    struct ggml_context *ctx;
+    struct ggml_scratch mark;
+    int ret;
+    
+    if (!state || !state->model || !state->model->ctx)
+        return -EINVAL;
+    
+    ctx = state->model->ctx;
+    mark = ggml_scratch_mark(ctx);
+    ret = llama_eval_graph(state, tokens, n_tokens, n_past);
+    ggml_scratch_release(ctx, mark);
+    
+    return ret;
+}
+
 /* Sample next token */
 int32_t llama_sample_token(struct llama_state *state) {
     if (!state || !state->logits || !state->model) {
@@ -980,22 +1185,6 @@ int llama_generate(struct llama_state *state,
         
         generated_tokens[n_gen++] = next_token;
         
-        /* Reset context to reuse memory for next token
-         * This is a hack but necessary to avoid running out of nodes
-         * We keep the model weights but reset the computation graph
-         */
-        if (state->model && state->model->ctx) {
-            /* Save current object count */
-            int saved_objects = state->model->ctx->n_objects;
-            
-            /* Find where temporary tensors start (after model weights) */
-            /* Assume first ~2000 objects are model weights */
-            if (saved_objects > 2000) {
-                state->model->ctx->n_objects = 2000;
-                state->model->ctx->mem_used = state->model->ctx->mem_used / 2; /* Rough estimate */
-            }
-        }
-        
         /* Evaluate new token */
         ret = llama_eval(state, &next_token, 1, state->n_past);
         if (ret < 0) {
@@ -1042,7 +1231,7 @@ int llama_generate(struct llama_state *state,
     
     /* Update peak memory if needed */
     if (state->model->ctx) {
-        u64 current_mem = state->model->ctx->mem_used;
+        u64 current_mem = state->model->ctx->mem_peak;
         u64 peak = atomic64_read(&llamux_perf_stats.peak_memory_used);
         if (current_mem > peak) {
             atomic64_set(&llamux_perf_stats.peak_memory_used, current_mem);
@@ -122,6 +122,9 @@ struct llama_model *llama_model_create_from_gguf(struct ggml_context *ctx, struc
 void llama_model_free(struct llama_model *model);
 int llama_model_load_weights(struct llama_model *model, void *data, size_t size);
 
+/* GGML context size (bytes) for a model, excluding its tensor data */
+size_t llama_model_ctx_size(const struct gguf_model *gguf);
+
 /* State functions */
 struct llama_state *llama_state_create(struct llama_model *model);
 void llama_state_free(struct llama_state *state);
@@ -15,6 +15,8 @@ extern struct {
     bool initialized;
     void *model_memory;
     size_t model_size;
+    void *ctx_memory;
+    size_t ctx_size;
     struct gguf_model *gguf_model;
     struct ggml_context *ggml_ctx;
     struct llama_model *llama;
@@ -24,22 +24,34 @@
 #include <linux/wait.h>
 #include <linux/file.h>
 #include <linux/namei.h>
+#include <linux/vmalloc.h>
+#include <linux/math64.h>
 #include "gguf_parser.h"
 #include "memory_reserve.h"
 #include "ggml_kernel.h"
 #include "llama_model.h"
 #include "llama_accel.h"
+#include "ggml_prof.h"
 
 #define LLAMUX_VERSION "0.1.0-alpha"
 #define MODEL_RESERVED_SIZE (2ULL * 1024 * 1024 * 1024) // 2GB
 #define MODEL_FIRMWARE_PATH "llamux/tinyllama.gguf"  /* Fallback for firmware API */
 #define MODEL_DIRECT_PATH "/lib/firmware/llamux/codellama-13b.gguf"  /* Direct file I/O path */
+#define LLAMUX_HEADER_PREFIX (8UL * 1024 * 1024)  /* First read for the GGUF header */
+#define LLAMUX_HEADER_SLACK 64  /* Zeroed bytes past the prefix */
 
 MODULE_LICENSE("GPL v2");
 MODULE_AUTHOR("Llamux Project");
 MODULE_DESCRIPTION("Llamux Core - LLM in the Linux Kernel");
 MODULE_VERSION(LLAMUX_VERSION);
 
+static bool map_weights;
+module_param(map_weights, bool, 0444);
+MODULE_PARM_DESC(map_weights, "Alias weights onto the model file's page cache instead of copying them");
+
+/* Pinned page-cache pages behind the weights when map_weights is set */
+static struct gguf_mapping llamux_weight_map;
+
 /* Performance statistics */
 struct llamux_stats {
     /* Token generation stats */
@@ -77,6 +89,8 @@ struct {
     bool initialized;
     void *model_memory;
     size_t model_size;
+    void *ctx_memory;
+    size_t ctx_size;
     struct gguf_model *gguf_model;
     struct ggml_context *ggml_ctx;
     struct llama_model *llama;
@@ -91,6 +105,8 @@ struct {
     .initialized = false,
     .model_memory = NULL,
     .model_size = 0,
+    .ctx_memory = NULL,
+    .ctx_size = 0,
     .gguf_model = NULL,
     .ggml_ctx = NULL,
     .llama = NULL,
@@ -129,6 +145,10 @@ static int llamux_status_show(struct seq_file *m, void *v)
     
     seq_printf(m, "\nMemory Status:\n");
     seq_printf(m, "--------------\n");
+    if (llamux_weight_map.vaddr) {
+        seq_printf(m, "Weight Mapping: %lu MB of page cache\n",
+                   (llamux_weight_map.n_pages << PAGE_SHIFT) / (1024*1024));
+    }
     if (llamux_mem_region.reserved) {
         size_t used = llamux_mem_region.size - (llamux_mem_region.size - llama_state.model_size);
         seq_printf(m, "Reserved Memory: %zu MB\n", llamux_mem_region.size / (1024*1024));
@@ -136,7 +156,8 @@ static int llamux_status_show(struct seq_file *m, void *v)
         seq_printf(m, "Virtual Address: %p\n", llamux_mem_region.virt_addr);
         seq_printf(m, "Memory Used: %zu MB\n", used / (1024*1024));
     } else {
-        seq_printf(m, "Using vmalloc: %zu MB\n", llama_state.model_size / (1024*1024));
+        seq_printf(m, "Weight Pool: %zu MB\n", llama_state.model_size / (1024*1024));
+        seq_printf(m, "Context Pool: %zu MB\n", llama_state.ctx_size / (1024*1024));
     }
     
     if (llama_state.llama) {
@@ -184,6 +205,12 @@ static int llamux_stats_show(struct seq_file *m, void *v)
     u64 total_time_ms = atomic64_read(&llamux_perf_stats.total_inference_time_ms);
     u64 cache_hits = atomic64_read(&llamux_perf_stats.cache_hits);
     u64 cache_misses = atomic64_read(&llamux_perf_stats.cache_misses);
+    
+    /* The weight cache counts per CPU; fold it in when there is one */
+    if (llama_state.llama && llama_state.llama->weight_cache) {
+        llama_weight_cache_read_stats(llama_state.llama->weight_cache,
+                                      &cache_hits, &cache_misses);
+    }
     u64 total_requests = atomic64_read(&llamux_perf_stats.total_requests);
     u64 failed_requests = atomic64_read(&llamux_perf_stats.failed_requests);
     int current_tps = atomic_read(&llamux_perf_stats.current_tokens_per_sec);
@@ -230,11 +257,17 @@ static int llamux_stats_show(struct seq_file *m, void *v)
     if (llama_state.llama && llama_state.llama->weight_cache) {
         struct llama_weight_cache *cache = llama_state.llama->weight_cache;
         seq_printf(m, "\nWeight Cache Details:\n");
-        seq_printf(m, "  Max Cache Size: %zu MB\n", cache->max_cache_size / (1024*1024));
+        seq_printf(m, "  Max Cache Size: %zu MB\n", llama_weight_cache_budget(cache) / (1024*1024));
         seq_printf(m, "  Cache Used: %zu MB\n", 
                    cache->total_cache_size / (1024*1024));
-        seq_printf(m, "  Cache Hits: %d\n", atomic_read(&cache->cache_hits));
-        seq_printf(m, "  Cache Misses: %d\n", atomic_read(&cache->cache_misses));
+        seq_printf(m, "  Cache Hits: %llu\n", cache_hits);
+        seq_printf(m, "  Cache Misses: %llu\n", cache_misses);
+        int evictions, reclaim_evictions;
+        
+        llama_weight_cache_evictions(cache, &evictions, &reclaim_evictions);
+        seq_printf(m, "  Cache Evictions: %d\n", evictions);
+        seq_printf(m, "  Reclaim Evictions: %d\n", reclaim_evictions);
+        seq_printf(m, "  Misses Not Admitted: %d\n", atomic_read(&cache->cache_rejects));
     }
     
     return 0;
@@ -245,6 +278,77 @@ static int llamux_stats_open(struct inode *inode, struct file *file)
     return single_open(file, llamux_stats_show, NULL);
 }
 
+/* Tenths of a percent of part in whole */
+static u64 llamux_permille(u64 part, u64 whole)
+{
+    return whole ? div64_u64(part * 1000, whole) : 0;
+}
+
+/*
+ * Compute engine telemetry via /proc/llamux/accel
+ */
+static int llamux_accel_show(struct seq_file *m, void *v)
+{
+    struct llama_accel_stats *stats;
+    u64 pm;
+    int i;
+    
+    stats = kzalloc(sizeof(*stats), GFP_KERNEL);
+    if (!stats)
+        return -ENOMEM;
+    
+    if (llama_accel_get_stats(stats)) {
+        seq_printf(m, "Acceleration engine not running\n");
+        kfree(stats);
+        return 0;
+    }
+    
+    seq_printf(m, "🦙 Llamux Compute Engine\n");
+    seq_printf(m, "========================\n\n");
+    seq_printf(m, "Threads: %d\n", stats->nr_threads);
+    seq_printf(m, "Pending Requests: %d\n", stats->pending);
+    seq_printf(m, "Total Requests: %llu\n", stats->total_requests);
+    seq_printf(m, "Run Inline (rings full): %llu\n", stats->inline_requests);
+    seq_printf(m, "Total Compute: %llu ms\n\n", div_u64(stats->total_compute_ns, NSEC_PER_MSEC));
+    
+    seq_printf(m, "%4s %4s %7s %7s %6s %10s %10s %10s %10s\n",
+               "idx", "cpu", "busy%", "spin%", "queue", "requests", "stolen",
+               "spin_wake", "sleeps");
+    for (i = 0; i < stats->nr_threads; i++) {
+        struct llama_accel_thread_stats *ts = &stats->threads[i];
+        u64 spin_pm = llamux_permille(ts->spin_ns, ts->uptime_ns);
+        
+        pm = llamux_permille(ts->busy_ns, ts->uptime_ns);
+        seq_printf(m, "%4d %4d %5llu.%llu %5llu.%llu %6ld %10llu %10llu %10llu %10llu\n",
+                   i, ts->cpu, pm / 10, pm % 10, spin_pm / 10, spin_pm % 10,
+                   ts->queue_depth, ts->processed, ts->stolen,
+                   ts->spin_wakeups, ts->sleeps);
+    }
+    
+    seq_printf(m, "\n%-14s %10s %12s %12s %10s %10s\n",
+               "op", "count", "run_ms", "wait_ms", "avg_run_us", "avg_wait_us");
+    for (i = 0; i < LLAMA_OP_COUNT; i++) {
+        u64 count = stats->ops[i].count;
+        
+        if (!count)
+            continue;
+        seq_printf(m, "%-14s %10llu %12llu %12llu %10llu %10llu\n",
+                   llama_accel_op_name(i), count,
+                   div_u64(stats->ops[i].run_ns, NSEC_PER_MSEC),
+                   div_u64(stats->ops[i].wait_ns, NSEC_PER_MSEC),
+                   div64_u64(stats->ops[i].run_ns, count * NSEC_PER_USEC),
+                   div64_u64(stats->ops[i].wait_ns, count * NSEC_PER_USEC));
+    }
+    
+    kfree(stats);
+    return 0;
+}
+
+static int llamux_accel_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, llamux_accel_show, NULL);
+}
+
 static const struct proc_ops llamux_status_fops = {
     .proc_open = llamux_status_open,
     .proc_read = seq_read,
@@ -259,6 +363,13 @@ static const struct proc_ops llamux_stats_fops = {
     .proc_release = single_release,
 };
 
+static const struct proc_ops llamux_accel_fops = {
+    .proc_open = llamux_accel_open,
+    .proc_read = seq_read,
+    .proc_lseek = seq_lseek,
+    .proc_release = single_release,
+};
+
 /*
  * Inference thread - processes LLM requests
  */
@@ -323,12 +434,80 @@ static int llama_inference_thread(void *data)
 /*
  * Load the TinyLlama model
  */
+/* Release the tensor data and GGML context memory */
+static void llama_free_model_memory(void)
+{
+    gguf_unmap_tensor_data(&llamux_weight_map);
+    if (llamux_mem_region.mapped) {
+        llamux_unmap_reserved_memory();
+    } else {
+        llama_accel_free(llama_state.ctx_memory);
+        llama_accel_free(llama_state.model_memory);
+        llama_accel_pools_free();
+    }
+    llama_state.model_memory = NULL;
+    llama_state.model_size = 0;
+    llama_state.ctx_memory = NULL;
+    llama_state.ctx_size = 0;
+}
+
+/*
+ * Parse everything in front of the tensor data from a prefix of the file.
+ * The prefix starts at LLAMUX_HEADER_PREFIX and doubles only while the
+ * parser reports the header running past it (-ENODATA); a malformed
+ * header fails at once. The zeroed tail keeps the parser's fixed-size
+ * reads in bounds.
+ */
+static int llama_parse_model_header(struct file *filp, loff_t file_size,
+                                    struct gguf_model *model)
+{
+    size_t prefix = min_t(loff_t, file_size, LLAMUX_HEADER_PREFIX);
+    void *buf;
+    int ret;
+    
+    for (;;) {
+        buf = vzalloc(prefix + LLAMUX_HEADER_SLACK);
+        if (!buf)
+            return -ENOMEM;
+        
+        ret = gguf_file_read(filp, 0, buf, prefix);
+        if (ret)
+            goto out;
+        
+        ret = gguf_parse_header(buf, prefix, &model->header);
+        if (ret)
+            goto out;
+        
+        ret = gguf_parse_tensor_info(buf, prefix, model);
+        if (ret != -ENODATA)
+            goto out;
+        if (prefix == file_size) {
+            pr_err("🦙 Llamux: Model header runs past the end of the file\n");
+            ret = -EINVAL;
+            goto out;
+        }
+        
+        /* Ran off the end of the prefix - start over with twice as much */
+        vfree(buf);
+        gguf_free_model(model);
+        memset(model, 0, sizeof(*model));
+        prefix = min_t(loff_t, file_size, (loff_t)prefix * 2);
+        pr_info("🦙 Llamux: Model header needs more than %zu KB, rereading\n",
+                prefix / 2048);
+    }
+out:
+    if (!ret)
+        pr_info("🦙 Llamux: Parsed model header from the first %zu KB\n", prefix / 1024);
+    vfree(buf);
+    return ret;
+}
+
 static int llama_load_model(void)
 {
     struct file *filp = NULL;
+    struct gguf_loader loader;
     loff_t file_size;
-    loff_t pos = 0;
-    void *model_data = NULL;
+    bool loading;
     int ret;
     
     pr_info("🦙 Llamux: Loading CodeLlama 13B model using direct file I/O...\n");
@@ -341,20 +520,10 @@ static int llama_load_model(void)
             return ret;
         }
         llamux_print_memory_info();
+        llama_state.model_memory = llamux_mem_region.virt_addr;
+        llama_state.model_size = llamux_mem_region.size;
     } else {
-        pr_warn("🦙 Llamux: No reserved memory, using vmalloc fallback\n");
-        /* Fallback to vmalloc for testing */
-        /* CodeLlama 13B Q4_K_M: ~7.3GB + KV cache + GGML overhead */
-        size_t alloc_size = (size_t)30720 * 1024 * 1024; /* 30GB total - let's go big! */
-        pr_info("🦙 Llamux: Attempting to allocate %zu MB with vmalloc\n", alloc_size / (1024 * 1024));
-        llama_state.model_memory = vmalloc(alloc_size);
-        if (!llama_state.model_memory) {
-            pr_err("🦙 Llamux: Failed to allocate model memory (%zu bytes)\n", alloc_size);
-            return -ENOMEM;
-        }
-        pr_info("🦙 Llamux: Successfully allocated %zu MB at %p\n", 
-                alloc_size / (1024 * 1024), llama_state.model_memory);
-        llama_state.model_size = alloc_size;
+        pr_info("🦙 Llamux: No reserved memory, using huge-page pools sized from the model\n");
     }
     
     /* Open model file directly */
@@ -370,97 +539,31 @@ static int llama_load_model(void)
     file_size = i_size_read(file_inode(filp));
     pr_info("🦙 Llamux: Model file size: %lld MB\n", file_size / (1024*1024));
     
-    /* Allocate temporary buffer for model data */
-    model_data = vmalloc(file_size);
-    if (!model_data) {
-        pr_err("🦙 Llamux: Failed to allocate buffer for model data (%lld bytes)\n", file_size);
-        ret = -ENOMEM;
-        goto err_close_file;
-    }
-    
-    /* Read file in chunks to handle large files */
-    pr_info("🦙 Llamux: Reading model file into memory in chunks...\n");
-    {
-        size_t chunk_size = 512 * 1024 * 1024; /* 512MB chunks */
-        size_t bytes_read = 0;
-        
-        while (bytes_read < file_size) {
-            size_t to_read = min(chunk_size, (size_t)(file_size - bytes_read));
-            ssize_t chunk_ret;
-            
-            chunk_ret = kernel_read(filp, (char*)model_data + bytes_read, to_read, &pos);
-            if (chunk_ret <= 0) {
-                pr_err("🦙 Llamux: Failed to read chunk at offset %zu: %zd\n", 
-                       bytes_read, chunk_ret);
-                ret = chunk_ret ? chunk_ret : -EIO;
-                goto err_free_model_data;
-            }
-            
-            bytes_read += chunk_ret;
-            if (bytes_read % (1024 * 1024 * 1024) == 0) {
-                pr_info("🦙 Llamux: Read %zu GB so far...\n", bytes_read / (1024 * 1024 * 1024));
-            }
-        }
-        
-        if (bytes_read != file_size) {
-            pr_err("🦙 Llamux: Read size mismatch: expected %lld, got %zu\n", 
-                   file_size, bytes_read);
-            ret = -EIO;
-            goto err_free_model_data;
-        }
-    }
-    
-    pr_info("🦙 Llamux: Successfully read %lld MB from model file\n", file_size / (1024*1024));
-    
-    /* Close file - we have the data in memory now */
-    filp_close(filp, NULL);
-    filp = NULL;
-    
-    /* Now process the model data as before */
     if (file_size < sizeof(struct gguf_header)) {
         pr_err("🦙 Llamux: Model file too small\n");
         ret = -EINVAL;
-        goto err_free_model_data;
+        goto err_close_file;
     }
     
     /* Allocate GGUF model structure */
     llama_state.gguf_model = kzalloc(sizeof(struct gguf_model), GFP_KERNEL);
     if (!llama_state.gguf_model) {
         ret = -ENOMEM;
-        goto err_free_model_data;
+        goto err_close_file;
     }
     
-    /* Parse GGUF file */
-    ret = gguf_parse_header(model_data, file_size, &llama_state.gguf_model->header);
+    /* Phase one: parse the header, metadata and tensor info from the front of the file */
+    ret = llama_parse_model_header(filp, file_size, llama_state.gguf_model);
     if (ret) {
         pr_err("🦙 Llamux: Failed to parse GGUF header\n");
         goto err_free_gguf;
     }
     
-    pr_info("🦙 Llamux: GGUF version %u, %llu tensors, %llu metadata entries\n",
-            llama_state.gguf_model->header.version,
-            llama_state.gguf_model->header.tensor_count,
-            llama_state.gguf_model->header.metadata_kv_count);
-    
-    /* Parse metadata */
-    ret = gguf_parse_metadata(model_data, file_size, llama_state.gguf_model);
-    if (ret < 0) {
-        pr_err("🦙 Llamux: Failed to parse metadata\n");
-        goto err_free_gguf;
-    }
-    
     /* Set default vocab size if not found in metadata */
     if (llama_state.gguf_model->vocab_size == 0) {
         llama_state.gguf_model->vocab_size = 32000; /* CodeLlama default */
     }
     
-    /* Parse tensor info */
-    ret = gguf_parse_tensor_info(model_data, file_size, llama_state.gguf_model);
-    if (ret) {
-        pr_err("🦙 Llamux: Failed to parse tensor info\n");
-        goto err_free_gguf;
-    }
-    
     /* Validate model */
     ret = gguf_validate_model(llama_state.gguf_model);
     if (ret) {
@@ -476,29 +579,68 @@ static int llama_load_model(void)
     pr_info("🦙 Llamux: Tensor data size: %zu MB\n", 
             tensor_data_size / (1024 * 1024));
     
-    /* Load tensor data */
-    ret = gguf_load_tensor_data(model_data, file_size, llama_state.gguf_model,
-                               llama_state.model_memory, llama_state.model_size);
-    if (ret) {
-        pr_warn("🦙 Llamux: Failed to load tensor data, using mock weights\n");
-    } else {
-        pr_info("🦙 Llamux: Loaded tensor data successfully!\n");
+    if (!llamux_mem_region.reserved) {
+        size_t ctx_size = llama_model_ctx_size(llama_state.gguf_model);
+        
+        /* Mapped weights live in the page cache - no weight pool */
+        ret = llama_accel_pools_init(map_weights ? 0 : tensor_data_size, ctx_size);
+        if (ret)
+            goto err_free_gguf;
+        
+        if (!map_weights) {
+            llama_state.model_memory = llama_accel_alloc(tensor_data_size, true);
+            llama_state.model_size = tensor_data_size;
+        }
+        llama_state.ctx_memory = llama_accel_alloc(ctx_size, false);
+        if ((!map_weights && !llama_state.model_memory) || !llama_state.ctx_memory) {
+            ret = -ENOMEM;
+            goto err_free_gguf;
+        }
+        llama_state.ctx_size = ctx_size;
     }
     
-    /* Free the temporary model data buffer - tensor data is now in model_memory */
-    vfree(model_data);
-    model_data = NULL;
+    /* Phase two: map the weights, or have loader threads stream each tensor into its slot */
+    if (map_weights) {
+        ret = gguf_map_tensor_data(&llamux_weight_map, filp, file_size, llama_state.gguf_model);
+        if (ret) {
+            pr_err("🦙 Llamux: Failed to map tensor data from the page cache\n");
+            goto err_free_gguf;
+        }
+        loading = false;
+    } else {
+        ret = gguf_load_start(&loader, filp, file_size, llama_state.gguf_model,
+                              llama_state.model_memory, llama_state.model_size);
+        loading = !ret;
+    }
     
     /* Initialize GGML context - needs enough for model tensors */
-    /* After loading tensor data, use remaining memory for GGML context */
-    size_t tensor_data_used = file_size - llama_state.gguf_model->data_offset;
-    size_t remaining_size = llama_state.model_size - tensor_data_used;
-    void *ctx_mem = (char*)llama_state.model_memory + tensor_data_used;
+    /* Reserved memory: use what the tensor data left over for the GGML context */
+    if (llamux_mem_region.reserved) {
+        size_t tensor_data_used = map_weights ? 0 :
+                                  file_size - llama_state.gguf_model->data_offset;
+        
+        llama_state.ctx_memory = (char*)llama_state.model_memory + tensor_data_used;
+        llama_state.ctx_size = llama_state.model_size - tensor_data_used;
+        pr_info("🦙 Llamux: Tensor data used %zu MB, %zu MB remaining for GGML context\n", 
+                tensor_data_used / (1024 * 1024), llama_state.ctx_size / (1024 * 1024));
+    }
+    
+    pr_info("🦙 Llamux: Initializing GGML context with %zu MB\n", llama_state.ctx_size / (1024 * 1024));
+    llama_state.ggml_ctx = ggml_init(llama_state.ctx_size, llama_state.ctx_memory);
+    
+    /* Model creation reads the weights, so the load has to be done first */
+    if (loading)
+        ret = gguf_load_wait(&loader);
     
-    pr_info("🦙 Llamux: Tensor data used %zu MB, %zu MB remaining for GGML context\n", 
-            tensor_data_used / (1024 * 1024), remaining_size / (1024 * 1024));
-    pr_info("🦙 Llamux: Initializing GGML context with %zu MB\n", remaining_size / (1024 * 1024));
-    llama_state.ggml_ctx = ggml_init(remaining_size, ctx_mem);
+    filp_close(filp, NULL);
+    filp = NULL;
+    
+    /* Part of the arena was never read - don't run on whatever it held */
+    if (ret) {
+        pr_err("🦙 Llamux: Failed to load tensor data\n");
+        goto err_free_ggml;
+    }
+    pr_info("🦙 Llamux: Loaded tensor data successfully!\n");
     
     if (!llama_state.ggml_ctx) {
         pr_err("🦙 Llamux: Failed to initialize GGML\n");
@@ -538,19 +680,11 @@ err_free_gguf:
         kfree(llama_state.gguf_model);
         llama_state.gguf_model = NULL;
     }
-err_free_model_data:
-    if (model_data)
-        vfree(model_data);
 err_close_file:
     if (filp && !IS_ERR(filp))
         filp_close(filp, NULL);
 err_free_memory:
-    if (llamux_mem_region.mapped) {
-        llamux_unmap_reserved_memory();
-    } else if (llama_state.model_memory) {
-        vfree(llama_state.model_memory);
-        llama_state.model_memory = NULL;
-    }
+    llama_free_model_memory();
     return ret;
 }
 /*
@@ -584,13 +718,7 @@ static void llama_unload_model(void)
     }
     
     /* Free memory */
-    if (llamux_mem_region.mapped) {
-        llamux_unmap_reserved_memory();
-    } else if (llama_state.model_memory) {
-        vfree(llama_state.model_memory);
-        llama_state.model_memory = NULL;
-        llama_state.model_size = 0;
-    }
+    llama_free_model_memory();
     
     pr_info("🦙 Llamux: Model unloaded and memory freed\n");
 }
@@ -632,6 +760,13 @@ static int __init llama_init(void)
         return -ENOMEM;
     }
     
+    /* Create /proc/llamux/accel */
+    if (!proc_create("accel", 0444, llamux_proc_dir, &llamux_accel_fops)) {
+        pr_err("🦙 Llamux: Failed to create /proc/llamux/accel\n");
+        proc_remove(llamux_proc_dir);
+        return -ENOMEM;
+    }
+    
     /* Create /proc/llamux/prompt */
     ret = llamux_create_prompt_interface(llamux_proc_dir);
     if (ret) {
@@ -652,14 +787,10 @@ static int __init llama_init(void)
     {
         cpumask_t compute_cpus;
         
-        /* Use CPUs 2-5 for compute (adjust based on your system) */
-        cpumask_clear(&compute_cpus);
-        cpumask_set_cpu(2, &compute_cpus);
-        cpumask_set_cpu(3, &compute_cpus);
-        cpumask_set_cpu(4, &compute_cpus);
-        cpumask_set_cpu(5, &compute_cpus);
-        
-        ret = llama_accel_init(&compute_cpus);
+        /* compute_cpus / compute_threads module parameters, topology-picked by default */
+        ret = llama_accel_select_cpus(&compute_cpus);
+        if (!ret)
+            ret = llama_accel_init(&compute_cpus);
         if (ret) {
             pr_warn("🦙 Llamux: Failed to init acceleration (%d), continuing without\n", ret);
             /* Not fatal - we can run without acceleration */
@@ -678,11 +809,16 @@ static int __init llama_init(void)
         return -ENOMEM;
     }
     
+    /* Per-op latency histograms - not fatal without them */
+    if (ggml_prof_init())
+        pr_warn("🦙 Llamux: Op profiling unavailable\n");
+    
     /* Start inference thread */
     llama_state.inference_thread = kthread_create(llama_inference_thread, 
                                                   NULL, "llamux_inference");
     if (IS_ERR(llama_state.inference_thread)) {
         pr_err("🦙 Llamux: Failed to create inference thread\n");
+        ggml_prof_exit();
         llama_unload_model();
         kfree(llama_state.current_prompt);
         kfree(llama_state.current_response);
@@ -710,6 +846,9 @@ static void __exit llama_exit(void)
     
     llama_state.initialized = false;
     
+    /* Remove proc entries first - waits for readers still inside them */
+    proc_remove(llamux_proc_dir);
+    
     /* Stop inference thread */
     if (llama_state.inference_thread && !IS_ERR(llama_state.inference_thread)) {
         pr_info("🦙 Llamux: Stopping inference thread...\n");
@@ -720,20 +859,19 @@ static void __exit llama_exit(void)
         llama_state.inference_thread = NULL;
     }
     
+    ggml_prof_exit();
+    
     /* Free buffers */
     kfree(llama_state.current_prompt);
     kfree(llama_state.current_response);
     llama_state.current_prompt = NULL;
     llama_state.current_response = NULL;
     
-    /* Cleanup acceleration engine */
-    llama_accel_cleanup();
-    
-    /* Unload model */
+    /* Unload model - stops cache warm-up, the last user of the engine */
     llama_unload_model();
     
-    /* Remove proc entries */
-    proc_remove(llamux_proc_dir);
+    /* Cleanup acceleration engine */
+    llama_accel_cleanup();
     
     pr_info("🦙 Llamux: Goodbye!\n");
 }
@@ -4,104 +4,45 @@
 
 #include <linux/kernel.h>
 #include <linux/string.h>
-#include <linux/sched.h>
-#include <asm/fpu/api.h>
 #include "quantize.h"
 #include "gguf_parser.h"
 
-/* Dequantize Q4_K block - kernel-friendly implementation */
+/*
+ * Dequantize Q4_K blocks - kernel-friendly implementation
+ *
+ * Like every dequantizer here this does no FPU bracketing of its own:
+ * the caller holds a llama_fpu_region around the whole batch of rows.
+ */
 void dequantize_q4_K(const struct block_q4_K *x, float *y, int k) {
     const int nb = k / QK_K;
-    static int debug_count = 0;
-    
-    /* Reset debug count for testing */
-    debug_count = 0;
     
     for (int i = 0; i < nb; i++) {
         const struct block_q4_K *block = &x[i];
         
-        /* Be a good citizen - yield CPU if needed (but less often) */
-        if (i > 0 && (i % 256) == 0) {
-            if (need_resched()) {
-                cond_resched();
-            }
-        }
-        
-        /* Extract scales - Q4_K uses complex scale packing */
         /* CRITICAL: d and dmin are FP16 (half precision), not regular floats! */
-        kernel_fpu_begin();
         const float d = ggml_fp16_to_fp32(block->d);
         const float dmin = ggml_fp16_to_fp32(block->dmin);
-        kernel_fpu_end();
-        
-        /* Unpack scales - Q4_K has 2 scales per byte for 16 groups */
-        uint8_t scales[16];
-        for (int j = 0; j < 8; j++) {
-            uint8_t byte = block->scales[j];
-            scales[j*2] = byte & 63;
-            scales[j*2 + 1] = byte >> 6;
-        }
-        /* Remaining 4 bytes contain mins for each scale */
-        uint8_t mins[16];
-        for (int j = 0; j < 4; j++) {
-            uint8_t byte = block->scales[8 + j];
-            mins[j*4] = (byte & 3);
-            mins[j*4 + 1] = ((byte >> 2) & 3);
-            mins[j*4 + 2] = ((byte >> 4) & 3);
-            mins[j*4 + 3] = (byte >> 6);
-        }
-        
-        /* Debug first few blocks */
-        if (debug_count < 3 && i < 3) {
-            kernel_fpu_begin();
-            int d_int = (int)(d * 1000000);
-            int dmin_int = (int)(dmin * 1000000);
-            kernel_fpu_end();
-            pr_info("Q4_K dequant block[%d]: d_fp16=0x%04x->%d/1M, dmin_fp16=0x%04x->%d/1M\n",
-                    i, block->d, d_int, block->dmin, dmin_int);
-            pr_info("  First 4 scales: %d %d %d %d (raw bytes: 0x%02x 0x%02x 0x%02x)\n",
-                    scales[0], scales[1], scales[2], scales[3],
-                    block->scales[0], block->scales[1], block->scales[2]);
-            pr_info("  First 4 qs bytes: 0x%02x 0x%02x 0x%02x 0x%02x\n",
-                    block->qs[0], block->qs[1], block->qs[2], block->qs[3]);
-            if (i == 0) debug_count++;
-        }
-        
-        /* Dequantize values - 16 groups of 16 values each */
         float *dst = y + i*QK_K;
-        kernel_fpu_begin();
         
-        for (int j = 0; j < 16; j++) {
-            /* Q4_K formula: y = d * (x - 8) * sc + dmin * m */
-            const float sc = (float)scales[j];
-            const float m = (float)(mins[j] + 1);
+        /* 4 chunks of 64 values: low nibbles first, then high nibbles */
+        const uint8_t *q = block->qs;
+        for (int j = 0; j < QK_K / 64; j++) {
+            uint8_t sc, m;
             
-            const uint8_t *q = &block->qs[j * 8];
-            float *out = &dst[j * 16];
+            /* Q4_K formula: y = d * sc * q - dmin * m */
+            q4k_get_scale_min(2*j + 0, block->scales, &sc, &m);
+            const float d1 = d * sc;
+            const float m1 = dmin * m;
+            q4k_get_scale_min(2*j + 1, block->scales, &sc, &m);
+            const float d2 = d * sc;
+            const float m2 = dmin * m;
+            float *out = &dst[j * 64];
             
-            /* Dequantize 16 values */
-            for (int l = 0; l < 8; l++) {
-                const uint8_t vi = q[l];
-                const int8_t vi0 = (vi & 0xF);
-                const int8_t vi1 = (vi >> 4);
-                
-                out[l*2 + 0] = d * (vi0 - 8.0f) * sc + dmin * m;
-                out[l*2 + 1] = d * (vi1 - 8.0f) * sc + dmin * m;
+            for (int l = 0; l < 32; l++) {
+                out[l]      = d1 * (q[l] & 0xF) - m1;
+                out[l + 32] = d2 * (q[l] >> 4)  - m2;
             }
-        }
-        
-        kernel_fpu_end();
-        
-        /* Debug: check first few output values */
-        if (debug_count <= 3 && i == 0) {
-            kernel_fpu_begin();
-            int v0 = (int)(dst[0] * 1000);
-            int v1 = (int)(dst[1] * 1000);
-            int v2 = (int)(dst[2] * 1000);
-            int v3 = (int)(dst[3] * 1000);
-            kernel_fpu_end();
-            pr_info("  First 4 dequantized values (x1000): %d %d %d %d\n",
-                    v0, v1, v2, v3);
+            q += 32;
         }
     }
 }
@@ -126,6 +67,18 @@ void dequantize_q6_K(const void *x, float *y, int k) {
     }
 }
 
+/* Dequantize Q8_0 blocks */
+void dequantize_q8_0(const struct block_q8_0 *x, float *y, int k) {
+    dequantize_row_q8_0(x, y, k);
+}
+
+/* Convert F16 values to float */
+void dequantize_f16(const uint16_t *x, float *y, int k) {
+    for (int i = 0; i < k; i++) {
+        y[i] = ggml_fp16_to_fp32(x[i]);
+    }
+}
+
 /* Generic dequantization */
 void dequantize_row(const void *x, float *y, int k, enum ggml_type type) {
     switch (type) {
@@ -134,6 +87,14 @@ void dequantize_row(const void *x, float *y, int k, enum ggml_type type) {
         memcpy(y, x, k * sizeof(float));
         break;
         
+    case GGML_TYPE_F16:
+        dequantize_f16((const uint16_t *)x, y, k);
+        break;
+        
+    case GGML_TYPE_Q8_0:
+        dequantize_q8_0((const struct block_q8_0 *)x, y, k);
+        break;
+        
     case GGML_TYPE_Q4_K:
         dequantize_q4_K((const struct block_q4_K *)x, y, k);
         break;
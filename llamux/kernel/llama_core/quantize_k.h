@@ -0,0 +1,284 @@
+/*
+ * K-quant block layouts and integer kernels for Llamux
+ *
+ * Everything in here is plain C with no kernel dependencies so the same
+ * code can be compiled into userspace reference tests (see test/).
+ */
+
+#ifndef _LLAMUX_QUANTIZE_K_H
+#define _LLAMUX_QUANTIZE_K_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+#endif
+
+#ifndef __packed
+#define __packed __attribute__((packed))
+#endif
+
+/* Q4_K block size */
+#define QK_K 256
+#define K_SCALE_SIZE 12
+
+/* Q4_K block structure */
+struct block_q4_K {
+    union {
+        struct {
+            uint16_t d;                     /* super-block scale (FP16) */
+            uint16_t dmin;                  /* super-block min (FP16) */
+            uint8_t scales[K_SCALE_SIZE];   /* 12 bytes of scales */
+            uint8_t qs[QK_K/2];            /* 128 bytes of 4-bit quants */
+        } __packed;
+        uint8_t data[144];                  /* Total size for Q4_K */
+    };
+} __packed;
+
+/* Q8_0 block - 32 int8 weights sharing one FP16 scale */
+#define QK8_0 32
+
+struct block_q8_0 {
+    uint16_t d;                 /* delta (FP16) */
+    int8_t qs[QK8_0];           /* quants */
+} __packed;
+
+/* Q8_K block - activations quantized for integer dot products */
+struct block_q8_K {
+    float d;                    /* delta */
+    int8_t qs[QK_K];            /* quants */
+    int16_t bsums[QK_K/16];     /* sum of quants in groups of 16 */
+};
+
+/* FP16 to FP32 conversion */
+static inline float ggml_fp16_to_fp32(uint16_t h) {
+    union { uint32_t u; float f; } o;
+
+    uint32_t sign = (h >> 15) & 1;
+    uint32_t exp = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ff;
+
+    if (exp == 0) {
+        /* Zero or subnormal */
+        if (mant == 0) {
+            /* Zero */
+            o.u = sign << 31;
+        } else {
+            /* Subnormal - convert to normalized */
+            exp = 1;
+            while ((mant & 0x400) == 0) {
+                mant <<= 1;
+                exp--;
+            }
+            mant &= 0x3ff;
+            o.u = (sign << 31) | ((exp + 112) << 23) | (mant << 13);
+        }
+    } else if (exp == 31) {
+        /* Inf or NaN */
+        if (mant == 0) {
+            /* Infinity - use large value in kernel */
+            o.u = (sign << 31) | (0xfe << 23);
+        } else {
+            /* NaN - return 0 in kernel */
+            o.f = 0.0f;
+            return o.f;
+        }
+    } else {
+        /* Normal number */
+        o.u = (sign << 31) | ((exp + 112) << 23) | (mant << 13);
+    }
+
+    return o.f;
+}
+
+/* FP32 to FP16 conversion (round to nearest, subnormals flush to zero) */
+static inline uint16_t ggml_fp32_to_fp16(float f) {
+    union { float f; uint32_t u; } v = { f };
+    uint32_t sign = (v.u >> 16) & 0x8000;
+    int32_t exp = (int32_t)((v.u >> 23) & 0xff) - 127 + 15;
+    uint32_t mant = (v.u >> 13) & 0x3ff;
+
+    if (exp <= 0)
+        return sign;
+    if (exp >= 31)
+        return sign | 0x7bff;   /* clamp to largest finite half */
+
+    /* Round to nearest on the first dropped bit */
+    if (v.u & 0x1000) {
+        mant++;
+        if (mant == 0x400) {
+            mant = 0;
+            if (++exp >= 31)
+                return sign | 0x7bff;
+        }
+    }
+
+    return sign | (exp << 10) | mant;
+}
+
+/*
+ * Unpack the 6-bit scale and min of sub-block j (0..7) from the
+ * 12-byte packed scales array, same layout as upstream ggml.
+ */
+static inline void q4k_get_scale_min(int j, const uint8_t *q,
+                                     uint8_t *sc, uint8_t *m) {
+    if (j < 4) {
+        *sc = q[j] & 63;
+        *m  = q[j + 4] & 63;
+    } else {
+        *sc = (q[j + 4] & 0xF) | ((q[j - 4] >> 6) << 4);
+        *m  = (q[j + 4] >>  4) | ((q[j - 0] >> 6) << 4);
+    }
+}
+
+/*
+ * Integer part of a Q4_K x Q8_K dot product.
+ *
+ * For each super-block i this produces
+ *   isum[i] = sum_j sc_j * sum_l q4[l] * q8[l]
+ *   msum[i] = sum_j m_j  * sum_l q8[l]
+ * so that the real dot product is
+ *   sum_i y[i].d * (d_i * isum[i] - dmin_i * msum[i]).
+ * No floating point is touched here.
+ */
+static inline void q4k_q8k_dot_int(const struct block_q4_K *x,
+                                   const struct block_q8_K *y,
+                                   int nb, int32_t *isum, int32_t *msum) {
+    for (int i = 0; i < nb; i++) {
+        const uint8_t *q4 = x[i].qs;
+        const int8_t *q8 = y[i].qs;
+        int32_t si = 0;
+        int32_t sm = 0;
+
+        /* 4 chunks of 64 values: low nibbles then high nibbles */
+        for (int j = 0; j < QK_K / 64; j++) {
+            uint8_t sc0, m0, sc1, m1;
+            int32_t lo = 0, hi = 0;
+
+            q4k_get_scale_min(2 * j + 0, x[i].scales, &sc0, &m0);
+            q4k_get_scale_min(2 * j + 1, x[i].scales, &sc1, &m1);
+
+            for (int l = 0; l < 32; l++) {
+                lo += (int32_t)(q4[l] & 0xF) * q8[l];
+                hi += (int32_t)(q4[l] >> 4)  * q8[l + 32];
+            }
+            si += sc0 * lo + sc1 * hi;
+            sm += m0 * (y[i].bsums[4 * j + 0] + y[i].bsums[4 * j + 1]) +
+                  m1 * (y[i].bsums[4 * j + 2] + y[i].bsums[4 * j + 3]);
+
+            q4 += 32;
+            q8 += 64;
+        }
+
+        isum[i] = si;
+        msum[i] = sm;
+    }
+}
+
+/*
+ * Fold the per-block integer sums of one row into the final float.
+ * Caller must be inside an FPU region in kernel space.
+ */
+static inline float q4k_q8k_finalize(const struct block_q4_K *x,
+                                     const struct block_q8_K *y,
+                                     int nb, const int32_t *isum,
+                                     const int32_t *msum) {
+    float sum = 0.0f;
+
+    for (int i = 0; i < nb; i++) {
+        const float d = ggml_fp16_to_fp32(x[i].d) * y[i].d;
+        const float dmin = ggml_fp16_to_fp32(x[i].dmin) * y[i].d;
+        sum += d * (float)isum[i] - dmin * (float)msum[i];
+    }
+
+    return sum;
+}
+
+/*
+ * Quantize k floats (k multiple of QK_K) to Q8_K.
+ * Caller must be inside an FPU region in kernel space.
+ */
+static inline void quantize_row_q8_K(const float *x, struct block_q8_K *y, int k) {
+    const int nb = k / QK_K;
+
+    for (int i = 0; i < nb; i++) {
+        const float *xb = x + i * QK_K;
+        float amax = 0.0f;
+
+        for (int l = 0; l < QK_K; l++) {
+            const float ax = xb[l] < 0.0f ? -xb[l] : xb[l];
+            if (ax > amax) amax = ax;
+        }
+
+        if (amax == 0.0f) {
+            y[i].d = 0.0f;
+            for (int l = 0; l < QK_K; l++) y[i].qs[l] = 0;
+            for (int l = 0; l < QK_K / 16; l++) y[i].bsums[l] = 0;
+            continue;
+        }
+
+        const float iscale = 127.0f / amax;
+        for (int l = 0; l < QK_K; l++) {
+            const float v = iscale * xb[l];
+            int q = (int)(v + (v >= 0.0f ? 0.5f : -0.5f));
+            if (q > 127) q = 127;
+            if (q < -127) q = -127;
+            y[i].qs[l] = (int8_t)q;
+        }
+        for (int l = 0; l < QK_K / 16; l++) {
+            int sum = 0;
+            for (int m = 0; m < 16; m++) {
+                sum += y[i].qs[l * 16 + m];
+            }
+            y[i].bsums[l] = (int16_t)sum;
+        }
+        y[i].d = 1.0f / iscale;
+    }
+}
+
+/*
+ * Quantize k floats (k multiple of QK8_0) to Q8_0.
+ * Caller must be inside an FPU region in kernel space.
+ */
+static inline void quantize_row_q8_0(const float *x, struct block_q8_0 *y, int k) {
+    const int nb = k / QK8_0;
+
+    for (int i = 0; i < nb; i++) {
+        const float *xb = x + i * QK8_0;
+        float amax = 0.0f;
+
+        for (int l = 0; l < QK8_0; l++) {
+            const float ax = xb[l] < 0.0f ? -xb[l] : xb[l];
+            if (ax > amax) amax = ax;
+        }
+
+        const float d = amax / 127.0f;
+        const float id = d != 0.0f ? 1.0f / d : 0.0f;
+
+        y[i].d = ggml_fp32_to_fp16(d);
+        for (int l = 0; l < QK8_0; l++) {
+            const float v = xb[l] * id;
+            int q = (int)(v + (v >= 0.0f ? 0.5f : -0.5f));
+            if (q > 127) q = 127;
+            if (q < -127) q = -127;
+            y[i].qs[l] = (int8_t)q;
+        }
+    }
+}
+
+/*
+ * Dequantize k values (k multiple of QK8_0) from Q8_0.
+ * Caller must be inside an FPU region in kernel space.
+ */
+static inline void dequantize_row_q8_0(const struct block_q8_0 *x, float *y, int k) {
+    const int nb = k / QK8_0;
+
+    for (int i = 0; i < nb; i++) {
+        const float d = ggml_fp16_to_fp32(x[i].d);
+        for (int l = 0; l < QK8_0; l++) {
+            y[i * QK8_0 + l] = d * x[i].qs[l];
+        }
+    }
+}
+
+#endif /* _LLAMUX_QUANTIZE_K_H */
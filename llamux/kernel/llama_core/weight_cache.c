@@ -1,189 +1,807 @@
 /*
  * Weight Cache Implementation for Llamux
+ *
+ * Each entry's dequantized copy is published with rcu_assign_pointer()
+ * and read under SRCU, so a hit is an srcu_read_lock() (per-CPU), one
+ * acquire load of the entry and a per-CPU counter bump - no shared cache
+ * line is written. SRCU rather than RCU because readers hold the copy
+ * across a whole matmul, which yields the CPU. Fills and eviction are
+ * serialized by cache_lock; evicted copies are freed after a grace period.
+ * Fills never evict (see weight_cache_policy.h). Reclaim evicts with
+ * CLOCK: readers set the referenced bit (only if clear), the hand clears
+ * it and takes the first entry it finds unreferenced.
+ *
+ * An F32 copy costs 7x the Q4_K bytes, so by default only small tensors
+ * are kept in F32; large ones are repacked into Q8_0 (cheap to decode,
+ * ~1.06 bytes per weight) so a full model fits on a 64GB machine.
+ *
+ * The cache is registered as a shrinker: under memory pressure reclaim
+ * evicts entries through the CLOCK hand, and matmuls fall back to
+ * decoding from the source weights.
  */
 
 #include <linux/kernel.h>
+#include <linux/module.h>
 #include <linux/slab.h>
 #include <linux/mm.h>
-#include <linux/jiffies.h>
+#include <linux/math64.h>
+#include <linux/workqueue.h>
+#include <linux/shrinker.h>
 #include "weight_cache.h"
+#include "weight_cache_policy.h"
 #include "quantize.h"
 #include "llamux_stats.h"
+#include "llama_fpu.h"
+
+/*
+ * Cache budget override in MB, 0 = size given at init. Applies to the next
+ * miss. GGUF models only get a cache when this is set at load.
+ */
+static ulong weight_cache_mb;
+module_param(weight_cache_mb, ulong, 0644);
+MODULE_PARM_DESC(weight_cache_mb, "Weight cache budget in MB (0=default, no cache for GGUF models); weights past it stay uncached");
+
+bool llama_weight_cache_configured(void) {
+    return READ_ONCE(weight_cache_mb) != 0;
+}
+
+static int weight_cache_format = WEIGHT_CACHE_FMT_AUTO;
+module_param(weight_cache_format, int, 0644);
+MODULE_PARM_DESC(weight_cache_format, "Cached weight format: 0=auto, 1=f32, 2=f16, 3=q8_0. Applies to new entries");
+
+/* In auto mode, tensors up to this many elements are cached as F32 */
+static ulong weight_cache_f32_max = 1024 * 1024;
+module_param(weight_cache_f32_max, ulong, 0644);
+MODULE_PARM_DESC(weight_cache_f32_max, "Largest tensor (elements) cached as F32 in auto format mode");
+
+/* Most token embedding rows kept in F32 */
+static int weight_cache_embd_rows = 8192;
+module_param(weight_cache_embd_rows, int, 0644);
+MODULE_PARM_DESC(weight_cache_embd_rows, "Max token embedding rows cached in F32 (0=off)");
+
+/* Background warm-up workers after model load: -1 = half the online CPUs, 0 = off */
+static int weight_cache_warm_threads = -1;
+module_param(weight_cache_warm_threads, int, 0644);
+MODULE_PARM_DESC(weight_cache_warm_threads, "Workers pre-filling the weight cache at load (-1=auto, 0=off)");
+
+static void weight_cache_warm_cancel(struct llama_weight_cache *cache);
+
+/* Cached copies are optional - fail rather than invoke the OOM killer */
+#define WEIGHT_CACHE_GFP (GFP_KERNEL | __GFP_RETRY_MAYFAIL | __GFP_NOWARN)
+
+/* Elements decoded between FPU checkpoints (multiple of every block size) */
+#define WEIGHT_CACHE_DEQUANT_CHUNK (64 * 1024)
+
+/* Pick the cached format for a tensor; GGML_TYPE_COUNT means don't cache */
+static enum ggml_type weight_cache_pick_type(int64_t ne0, size_t n_elements,
+                                             enum ggml_type src_type) {
+    enum ggml_type type;
+    
+    switch (READ_ONCE(weight_cache_format)) {
+    case WEIGHT_CACHE_FMT_F32:
+        type = GGML_TYPE_F32;
+        break;
+    case WEIGHT_CACHE_FMT_F16:
+        type = GGML_TYPE_F16;
+        break;
+    case WEIGHT_CACHE_FMT_Q8_0:
+        type = GGML_TYPE_Q8_0;
+        break;
+    default:
+        type = n_elements <= READ_ONCE(weight_cache_f32_max) ? GGML_TYPE_F32 : GGML_TYPE_Q8_0;
+        break;
+    }
+    
+    /* Q8_0 blocks must not straddle rows */
+    if (type == GGML_TYPE_Q8_0 && ne0 % QK8_0)
+        type = GGML_TYPE_F16;
+    
+    /* A copy in the source format would only cost memory */
+    if (type == src_type)
+        return GGML_TYPE_COUNT;
+    
+    return type;
+}
+
+/*
+ * Decode a whole weight tensor into dst (in dst_type) inside one budgeted
+ * FPU region. Non-F32 targets go through an F32 bounce chunk.
+ */
+static int weight_cache_fill(const void *src, enum ggml_type src_type,
+                             void *dst, enum ggml_type dst_type,
+                             size_t n_elements) {
+    const size_t chunk_bytes = gguf_tensor_size(src_type, WEIGHT_CACHE_DEQUANT_CHUNK);
+    const size_t out_bytes = gguf_tensor_size(dst_type, WEIGHT_CACHE_DEQUANT_CHUNK);
+    struct llama_fpu_region fpu = { 0 };
+    float *tmp = NULL;
+    
+    if (dst_type != GGML_TYPE_F32) {
+        tmp = kvmalloc(WEIGHT_CACHE_DEQUANT_CHUNK * sizeof(float), GFP_KERNEL);
+        if (!tmp)
+            return -ENOMEM;
+    }
+    
+    llama_fpu_begin(&fpu);
+    for (size_t off = 0; off < n_elements; off += WEIGHT_CACHE_DEQUANT_CHUNK) {
+        const size_t chunk = off / WEIGHT_CACHE_DEQUANT_CHUNK;
+        const size_t len = min_t(size_t, WEIGHT_CACHE_DEQUANT_CHUNK, n_elements - off);
+        const void *in = (const char *)src + chunk * chunk_bytes;
+        void *out = (char *)dst + chunk * out_bytes;
+        
+        switch (dst_type) {
+        case GGML_TYPE_F32:
+            dequantize_row(in, out, len, src_type);
+            break;
+        case GGML_TYPE_F16:
+            dequantize_row(in, tmp, len, src_type);
+            for (size_t i = 0; i < len; i++)
+                ((uint16_t *)out)[i] = ggml_fp32_to_fp16(tmp[i]);
+            break;
+        case GGML_TYPE_Q8_0:
+            dequantize_row(in, tmp, len, src_type);
+            quantize_row_q8_0(tmp, out, len);
+            break;
+        default:
+            break;
+        }
+        llama_fpu_checkpoint(&fpu);
+    }
+    llama_fpu_end(&fpu);
+    
+    kvfree(tmp);
+    return 0;
+}
+
+size_t llama_weight_cache_budget(const struct llama_weight_cache *cache) {
+    ulong mb = READ_ONCE(weight_cache_mb);
+    
+    return mb ? (size_t)mb * 1024 * 1024 : cache->max_cache_size;
+}
+
+static void weight_cache_data_free(struct rcu_head *head) {
+    struct weight_cache_data *data = container_of(head, struct weight_cache_data, rcu);
+    
+    /* Reclaim is credited once the memory is actually gone */
+    if (data->reclaim)
+        atomic_long_add(data->size >> PAGE_SHIFT, &data->cache->reclaimed_pages);
+    kvfree(data->buf);
+    kfree(data);
+}
+
+/* Unpublish an entry and free its copy once readers are done. Caller holds cache_lock */
+static void weight_cache_drop(struct llama_weight_cache *cache,
+                              struct weight_cache_entry *entry) {
+    struct weight_cache_data *data =
+        rcu_dereference_protected(entry->data, lockdep_is_held(&cache->cache_lock));
+    
+    if (!data)
+        return;
+    
+    RCU_INIT_POINTER(entry->data, NULL);
+    cache->total_cache_size -= data->size;
+    data->reclaim = cache->reclaiming;
+    call_srcu(&cache->srcu, &data->rcu, weight_cache_data_free);
+}
+
+/* Advance the CLOCK hand until an unreferenced entry is evicted. Caller holds cache_lock */
+static bool weight_cache_evict_one(struct llama_weight_cache *cache) {
+    const int n_slots = cache->n_layers * MAX_WEIGHT_TYPES;
+    
+    /* Two sweeps: the first may only clear referenced bits */
+    for (int n = 0; n < 2 * n_slots; n++) {
+        struct weight_cache_entry *entry =
+            &cache->weights[cache->clock_hand / MAX_WEIGHT_TYPES][cache->clock_hand % MAX_WEIGHT_TYPES];
+        
+        cache->clock_hand = (cache->clock_hand + 1) % n_slots;
+        
+        if (!rcu_access_pointer(entry->data))
+            continue;
+        if (READ_ONCE(entry->referenced)) {
+            WRITE_ONCE(entry->referenced, false);
+            continue;
+        }
+        
+        weight_cache_drop(cache, entry);
+        atomic_inc(&cache->cache_evictions);
+        return true;
+    }
+    
+    return false;
+}
+
+/* Bytes reclaim could get back - embedding rows are pinned */
+static size_t weight_cache_evictable(struct llama_weight_cache *cache) {
+    size_t total = READ_ONCE(cache->total_cache_size);
+    size_t rows = (size_t)READ_ONCE(cache->embd.n_cached) * cache->embd.ne0 * sizeof(float);
+    
+    return total > rows ? total - rows : 0;
+}
+
+static unsigned long weight_cache_shrink_count(struct shrinker *shrink,
+                                               struct shrink_control *sc) {
+    struct llama_weight_cache *cache = container_of(shrink, struct llama_weight_cache, shrinker);
+    unsigned long pages = weight_cache_evictable(cache) >> PAGE_SHIFT;
+    
+    return pages ? pages : SHRINK_EMPTY;
+}
+
+/*
+ * Evicted copies are only freed after an SRCU grace period, and readers
+ * hold SRCU across a whole matmul, so reclaim cannot wait for them here.
+ * A scan queues up to nr_to_scan pages worth of evictions and reports
+ * what earlier evictions have actually given back since the last scan.
+ */
+static unsigned long weight_cache_shrink_scan(struct shrinker *shrink,
+                                              struct shrink_control *sc) {
+    struct llama_weight_cache *cache = container_of(shrink, struct llama_weight_cache, shrinker);
+    unsigned long evicted = 0, freed;
+    
+    /* Fills allocate under cache_lock - never wait on it from reclaim */
+    if (!mutex_trylock(&cache->cache_lock))
+        return SHRINK_STOP;
+    
+    /* Warm-up would only refill what reclaim takes */
+    WRITE_ONCE(cache->warm_stop, true);
+    
+    cache->reclaiming = true;
+    while (evicted < sc->nr_to_scan) {
+        size_t before = cache->total_cache_size;
+        
+        if (!weight_cache_evict_one(cache))
+            break;
+        atomic_inc(&cache->shrink_evictions);
+        evicted += (before - cache->total_cache_size) >> PAGE_SHIFT;
+    }
+    cache->reclaiming = false;
+    
+    mutex_unlock(&cache->cache_lock);
+    
+    sc->nr_scanned = evicted;
+    if (evicted)
+        pr_info_ratelimited("🦙 Weight Cache: Reclaim evicted %lu MB under memory pressure\n",
+                            evicted >> (20 - PAGE_SHIFT));
+    
+    freed = atomic_long_xchg(&cache->reclaimed_pages, 0);
+    if (freed)
+        return freed;
+    return evicted ? 0 : SHRINK_STOP;
+}
 
 /* Initialize weight cache */
 int llama_weight_cache_init(struct llama_weight_cache *cache, int n_layers, size_t max_size) {
-    if (!cache || n_layers <= 0 || n_layers > 128) {
+    int ret;
+    
+    if (!cache || n_layers <= 0 || n_layers > WEIGHT_CACHE_MAX_LAYERS) {
         return -EINVAL;
     }
     
     memset(cache, 0, sizeof(*cache));
     
+    cache->stats = alloc_percpu(struct weight_cache_pcpu_stats);
+    if (!cache->stats)
+        return -ENOMEM;
+    
+    ret = init_srcu_struct(&cache->srcu);
+    if (ret < 0)
+        goto err_stats;
+    
     cache->n_layers = n_layers;
     cache->max_cache_size = max_size;
     cache->enabled = true;
     
     mutex_init(&cache->cache_lock);
-    atomic_set(&cache->cache_hits, 0);
-    atomic_set(&cache->cache_misses, 0);
+    atomic_set(&cache->cache_evictions, 0);
+    atomic_set(&cache->shrink_evictions, 0);
+    atomic_set(&cache->cache_rejects, 0);
+    
+    /* Let reclaim take entries back before the OOM killer runs */
+    cache->shrinker.count_objects = weight_cache_shrink_count;
+    cache->shrinker.scan_objects = weight_cache_shrink_scan;
+    cache->shrinker.seeks = DEFAULT_SEEKS;
+    ret = register_shrinker(&cache->shrinker, "llamux-weight-cache");
+    if (ret)
+        goto err_srcu;
     
     pr_info("🦙 Weight Cache: Initialized for %d layers, max size %zu MB\n", 
-            n_layers, max_size / (1024 * 1024));
+            n_layers, llama_weight_cache_budget(cache) / (1024 * 1024));
     pr_info("🦙 Weight Cache: Ready to accelerate inference!\n");
     
     return 0;
+    
+err_srcu:
+    cleanup_srcu_struct(&cache->srcu);
+err_stats:
+    free_percpu(cache->stats);
+    cache->stats = NULL;
+    return ret;
 }
 
-/* Free weight cache */
+/* Free weight cache - no readers may be left */
 void llama_weight_cache_free(struct llama_weight_cache *cache) {
     int i, j;
     
     if (!cache) return;
     
+    /* Waits for a running scan */
+    unregister_shrinker(&cache->shrinker);
+    
+    weight_cache_warm_cancel(cache);
+    
     mutex_lock(&cache->cache_lock);
     
+    cache->enabled = false;
+    
     /* Free all cached weights */
     for (i = 0; i < cache->n_layers; i++) {
         for (j = 0; j < MAX_WEIGHT_TYPES; j++) {
-            struct weight_cache_entry *entry = &cache->weights[i][j];
-            if (entry->cached && entry->dequantized) {
-                kvfree(entry->dequantized);
-                entry->dequantized = NULL;
-                entry->cached = false;
-            }
+            weight_cache_drop(cache, &cache->weights[i][j]);
         }
     }
     
-    cache->total_cache_size = 0;
-    cache->enabled = false;
-    
     mutex_unlock(&cache->cache_lock);
     
+    /* Row readers copy under SRCU - wait them out before freeing rows */
+    synchronize_srcu(&cache->srcu);
+    if (cache->embd.rows) {
+        for (int64_t r = 0; r < cache->embd.n_rows; r++)
+            kvfree(cache->embd.rows[r]);
+        kvfree(cache->embd.rows);
+        cache->embd.rows = NULL;
+    }
+    
+    /* Wait for the deferred frees, then tear down SRCU */
+    srcu_barrier(&cache->srcu);
+    cleanup_srcu_struct(&cache->srcu);
+    free_percpu(cache->stats);
+    cache->stats = NULL;
+    
     pr_info("🦙 Weight Cache: Freed all cached weights\n");
 }
 
-/* Get cached weight or dequantize on demand */
-float *llama_weight_cache_get(struct llama_weight_cache *cache, 
-                             int layer, 
-                             enum weight_type type,
-                             const void *quantized_data,
-                             size_t n_elements,
-                             enum ggml_type quant_type) {
-    struct weight_cache_entry *entry;
-    float *result = NULL;
+/* Point ref at a published copy */
+static void weight_cache_ref_set(struct weight_cache_ref *ref,
+                                 const struct weight_cache_data *data) {
+    ref->data = data->buf;
+    ref->type = data->type;
+    ref->row_bytes = data->row_bytes;
+}
+
+/* Lockless lookup. Caller is inside an SRCU read section */
+static const void *weight_cache_lookup(struct llama_weight_cache *cache,
+                                       struct weight_cache_entry *entry,
+                                       struct weight_cache_ref *ref) {
+    struct weight_cache_data *data = srcu_dereference(entry->data, &cache->srcu);
     
-    if (!cache || !cache->enabled || layer >= cache->n_layers || 
-        type >= MAX_WEIGHT_TYPES || !quantized_data) {
+    if (!data)
         return NULL;
-    }
     
-    entry = &cache->weights[layer][type];
+    /* Only write the shared line when the bit actually changes */
+    if (!READ_ONCE(entry->referenced))
+        WRITE_ONCE(entry->referenced, true);
+    this_cpu_inc(cache->stats->hits);
     
-    /* Fast path - already cached */
-    if (entry->cached && entry->dequantized) {
-        atomic_inc(&cache->cache_hits);
-        /* Update global stats */
-        extern struct llamux_stats llamux_perf_stats;
-        atomic64_inc(&llamux_perf_stats.cache_hits);
-        
-        atomic_inc(&entry->ref_count);
-        entry->last_access = get_jiffies_64();
-        return entry->dequantized;
+    weight_cache_ref_set(ref, data);
+    return ref->data;
+}
+
+static void weight_cache_count_miss(struct llama_weight_cache *cache) {
+    extern struct llamux_stats llamux_perf_stats;
+    
+    this_cpu_inc(cache->stats->misses);
+    atomic64_inc(&llamux_perf_stats.cache_misses);
+}
+
+/*
+ * Decode one entry and publish it. cache_lock is only held to reserve
+ * budget and to publish, so warm-up workers decode in parallel and
+ * requests hitting other entries never wait behind a fill. With ref set
+ * (demand fill) the entry is returned referenced; warm-up fills pass NULL.
+ * Neither evicts - a weight that doesn't fit the free budget is left to
+ * the source data (-ENOSPC).
+ */
+static int weight_cache_fill_entry(struct llama_weight_cache *cache,
+                                   struct weight_cache_entry *entry,
+                                   int layer, enum weight_type type,
+                                   const void *quantized_data,
+                                   int64_t ne0, int64_t ne1,
+                                   enum ggml_type quant_type,
+                                   struct weight_cache_ref *ref) {
+    struct weight_cache_data *data;
+    const size_t n_elements = (size_t)ne0 * ne1;
+    enum ggml_type cache_type;
+    size_t size, budget;
+    int ret;
+    
+    /* Not worth a copy in this format - leave the caller on the source data */
+    cache_type = weight_cache_pick_type(ne0, n_elements, quant_type);
+    if (cache_type == GGML_TYPE_COUNT)
+        return -EOPNOTSUPP;
+    
+    /* Calculate size needed */
+    size = gguf_tensor_size(cache_type, n_elements);
+    
+    /* Full - every pass over the non-resident weights would land here */
+    budget = llama_weight_cache_budget(cache);
+    if (!weight_cache_admit(READ_ONCE(cache->total_cache_size), size, budget)) {
+        ret = -ENOSPC;
+        goto fail_full;
     }
     
-    /* Slow path - need to dequantize */
     mutex_lock(&cache->cache_lock);
     
     /* Double-check under lock */
-    if (entry->cached && entry->dequantized) {
-        atomic_inc(&cache->cache_hits);
-        /* Update global stats */
-        extern struct llamux_stats llamux_perf_stats;
-        atomic64_inc(&llamux_perf_stats.cache_hits);
-        
-        atomic_inc(&entry->ref_count);
-        entry->last_access = get_jiffies_64();
+    if (ref) {
+        ref->srcu_idx = srcu_read_lock(&cache->srcu);
+        if (weight_cache_lookup(cache, entry, ref)) {
+            mutex_unlock(&cache->cache_lock);
+            return 0;
+        }
+        srcu_read_unlock(&cache->srcu, ref->srcu_idx);
+    } else if (rcu_access_pointer(entry->data)) {
         mutex_unlock(&cache->cache_lock);
-        return entry->dequantized;
+        return -EEXIST;
     }
     
-    atomic_inc(&cache->cache_misses);
-    /* Update global stats */
-    extern struct llamux_stats llamux_perf_stats;
-    atomic64_inc(&llamux_perf_stats.cache_misses);
+    /* Someone else is decoding it - use the source data meanwhile */
+    if (entry->filling) {
+        mutex_unlock(&cache->cache_lock);
+        return -EBUSY;
+    }
     
-    /* Calculate size needed */
-    size_t size = n_elements * sizeof(float);
+    if (ref)
+        weight_cache_count_miss(cache);
     
-    /* Check cache size limit */
-    if (cache->total_cache_size + size > cache->max_cache_size) {
-        pr_warn("🦙 Weight Cache: Would exceed limit (%zu + %zu > %zu)\n",
-                cache->total_cache_size, size, cache->max_cache_size);
-        mutex_unlock(&cache->cache_lock);
-        return NULL;
+    /* Admission - recheck now that the size can't change under us */
+    ret = -ENOSPC;
+    if (!cache->enabled || !weight_cache_admit(cache->total_cache_size, size, budget)) {
+        if (ref)
+            atomic_inc(&cache->cache_rejects);
+        goto fail_unlock;
     }
     
-    /* Allocate buffer for dequantized weights */
-    entry->dequantized = kvmalloc(size, GFP_KERNEL);
-    if (!entry->dequantized) {
+    /* Reserve the space and claim the entry, then decode unlocked */
+    cache->total_cache_size += size;
+    entry->filling = true;
+    mutex_unlock(&cache->cache_lock);
+    
+    /* Allocate buffer for the decoded weights */
+    ret = -ENOMEM;
+    data = kzalloc(sizeof(*data), GFP_KERNEL);
+    if (!data)
+        goto fail_unreserve;
+    data->buf = kvmalloc(size, WEIGHT_CACHE_GFP);
+    if (!data->buf) {
         pr_err("🦙 Weight Cache: Failed to allocate %zu bytes\n", size);
-        mutex_unlock(&cache->cache_lock);
-        return NULL;
+        goto fail_data;
     }
+    data->cache = cache;
+    data->type = cache_type;
+    data->row_bytes = gguf_tensor_size(cache_type, ne0);
+    data->size = size;
     
-    /* Dequantize the weights */
-    pr_info("🦙 Weight Cache: Dequantizing layer %d type %d (%zu elements)\n",
-            layer, type, n_elements);
+    /* Decode the weights */
+    pr_info("🦙 Weight Cache: Caching layer %d type %d (%zu elements) as %s\n",
+            layer, type, n_elements, ggml_type_name(cache_type));
     
-    dequantize_row(quantized_data, entry->dequantized, n_elements, quant_type);
+    ret = weight_cache_fill(quantized_data, quant_type, data->buf, cache_type, n_elements);
+    if (ret)
+        goto fail_buf;
     
-    /* Update cache entry */
-    entry->quantized = (void *)quantized_data;
-    entry->size = size;
+    /* Update cache entry, then publish the fully written copy */
+    mutex_lock(&cache->cache_lock);
+    entry->filling = false;
+    entry->quantized = quantized_data;
     entry->n_elements = n_elements;
     entry->type = quant_type;
-    entry->cached = true;
-    entry->last_access = get_jiffies_64();
-    atomic_set(&entry->ref_count, 1);
+    WRITE_ONCE(entry->referenced, true);
+    rcu_assign_pointer(entry->data, data);
     
-    /* Update global stats */
-    cache->total_cache_size += size;
+    if (ref) {
+        ref->srcu_idx = srcu_read_lock(&cache->srcu);
+        weight_cache_ref_set(ref, data);
+    }
     
     mutex_unlock(&cache->cache_lock);
     
-    return entry->dequantized;
+    return 0;
+    
+fail_buf:
+    kvfree(data->buf);
+fail_data:
+    kfree(data);
+fail_unreserve:
+    mutex_lock(&cache->cache_lock);
+    entry->filling = false;
+    cache->total_cache_size -= size;
+fail_unlock:
+    mutex_unlock(&cache->cache_lock);
+    return ret;
+    
+fail_full:
+    if (ref) {
+        weight_cache_count_miss(cache);
+        atomic_inc(&cache->cache_rejects);
+    }
+    return ret;
+}
+
+/* Get cached weight or decode on demand */
+const void *llama_weight_cache_get(struct llama_weight_cache *cache, 
+                                   int layer, 
+                                   enum weight_type type,
+                                   const void *quantized_data,
+                                   int64_t ne0, int64_t ne1,
+                                   enum ggml_type quant_type,
+                                   struct weight_cache_ref *ref) {
+    struct weight_cache_entry *entry;
+    
+    if (!cache || !READ_ONCE(cache->enabled) || layer >= cache->n_layers || 
+        type >= MAX_WEIGHT_TYPES || !quantized_data) {
+        return NULL;
+    }
+    
+    entry = &cache->weights[layer][type];
+    
+    /* Fast path - already cached */
+    ref->srcu_idx = srcu_read_lock(&cache->srcu);
+    if (weight_cache_lookup(cache, entry, ref))
+        return ref->data;
+    srcu_read_unlock(&cache->srcu, ref->srcu_idx);
+    
+    /* Slow path - need to decode */
+    if (weight_cache_fill_entry(cache, entry, layer, type, quantized_data,
+                                ne0, ne1, quant_type, ref))
+        return NULL;
+    
+    return ref->data;
 }
 
 /* Release weight reference */
-void llama_weight_cache_release(struct llama_weight_cache *cache,
-                               int layer,
-                               enum weight_type type) {
+void llama_weight_cache_put(struct llama_weight_cache *cache,
+                            struct weight_cache_ref *ref) {
+    srcu_read_unlock(&cache->srcu, ref->srcu_idx);
+    ref->data = NULL;
+}
+
+/* Get the cached copy of a tagged weight tensor */
+const void *llama_weight_cache_get_tensor(struct llama_weight_cache *cache,
+                                          const struct ggml_tensor *t,
+                                          struct weight_cache_ref *ref) {
+    const int slot = t->cache_slot - 1;
+    
+    if (slot < 0)
+        return NULL;
+    
+    return llama_weight_cache_get(cache, slot / MAX_WEIGHT_TYPES,
+                                  slot % MAX_WEIGHT_TYPES, t->data,
+                                  t->ne[0], t->ne[1], t->type, ref);
+}
+
+/* Prefetch hint - the copy may be evicted as soon as the read section ends */
+const void *llama_weight_cache_peek(struct llama_weight_cache *cache,
+                                    const struct ggml_tensor *t, size_t *size) {
+    const int slot = t->cache_slot - 1;
+    const void *addr = t->data;
+    
+    *size = ggml_nbytes(t);
+    if (cache && slot >= 0 && slot / MAX_WEIGHT_TYPES < cache->n_layers) {
+        struct weight_cache_entry *entry =
+            &cache->weights[slot / MAX_WEIGHT_TYPES][slot % MAX_WEIGHT_TYPES];
+        struct weight_cache_data *data;
+        int idx;
+        
+        idx = srcu_read_lock(&cache->srcu);
+        data = srcu_dereference(entry->data, &cache->srcu);
+        if (data) {
+            addr = data->buf;
+            *size = data->size;
+        }
+        srcu_read_unlock(&cache->srcu, idx);
+    }
+    
+    return addr;
+}
+
+/* Remember where a slot's source weights live, for warm-up */
+void llama_weight_cache_register(struct llama_weight_cache *cache,
+                                 const struct ggml_tensor *t) {
+    const int slot = t ? t->cache_slot - 1 : -1;
     struct weight_cache_entry *entry;
     
-    if (!cache || !cache->enabled || layer >= cache->n_layers || 
-        type >= MAX_WEIGHT_TYPES) {
+    if (!cache || slot < 0 || slot / MAX_WEIGHT_TYPES >= cache->n_layers)
         return;
+    
+    entry = &cache->weights[slot / MAX_WEIGHT_TYPES][slot % MAX_WEIGHT_TYPES];
+    entry->src = t;
+}
+
+/* Warm-up worker - takes slots in layer order until none are left */
+static void weight_cache_warm_fn(struct work_struct *work) {
+    struct llama_weight_cache *cache =
+        container_of(work, struct weight_cache_warm_work, work)->cache;
+    const int n_slots = cache->n_layers * MAX_WEIGHT_TYPES;
+    int slot;
+    
+    while (!READ_ONCE(cache->warm_stop) &&
+           (slot = atomic_inc_return(&cache->warm_next) - 1) < n_slots) {
+        struct weight_cache_entry *entry =
+            &cache->weights[slot / MAX_WEIGHT_TYPES][slot % MAX_WEIGHT_TYPES];
+        const struct ggml_tensor *t = entry->src;
+        int ret;
+        
+        if (!t || t->type == GGML_TYPE_F32)
+            continue;
+        
+        ret = weight_cache_fill_entry(cache, entry, slot / MAX_WEIGHT_TYPES,
+                                      slot % MAX_WEIGHT_TYPES, t->data,
+                                      t->ne[0], t->ne[1], t->type, NULL);
+        if (ret == -ENOSPC) {
+            /* Budget full - later layers would only evict earlier ones */
+            WRITE_ONCE(cache->warm_stop, true);
+            break;
+        }
+        if (!ret)
+            atomic_inc(&cache->warm_filled);
+        cond_resched();
     }
     
-    entry = &cache->weights[layer][type];
+    if (atomic_dec_and_test(&cache->warm_active))
+        pr_info("🦙 Weight Cache: Warm-up done - %d tensors, %zu MB cached\n",
+                atomic_read(&cache->warm_filled),
+                READ_ONCE(cache->total_cache_size) / (1024 * 1024));
+}
+
+/* Stop warm-up and wait for in-flight fills */
+static void weight_cache_warm_cancel(struct llama_weight_cache *cache) {
+    WRITE_ONCE(cache->warm_stop, true);
+    for (int i = 0; i < cache->n_warm; i++)
+        flush_work(&cache->warm[i].work);
+    cache->n_warm = 0;
+}
+
+/* Start decoding every registered weight in the background */
+void llama_weight_cache_warm(struct llama_weight_cache *cache) {
+    int n_workers;
+    
+    if (!cache || !cache->enabled || !READ_ONCE(weight_cache_warm_threads))
+        return;
+    
+    /* A previous warm-up may still be running (model reload) */
+    weight_cache_warm_cancel(cache);
+    
+    n_workers = READ_ONCE(weight_cache_warm_threads);
+    if (n_workers < 0)
+        n_workers = max(1U, num_online_cpus() / 2);
+    n_workers = min(n_workers, WEIGHT_CACHE_WARM_MAX);
+    
+    atomic_set(&cache->warm_next, 0);
+    atomic_set(&cache->warm_filled, 0);
+    atomic_set(&cache->warm_active, n_workers);
+    WRITE_ONCE(cache->warm_stop, false);
+    
+    for (int i = 0; i < n_workers; i++) {
+        cache->warm[i].cache = cache;
+        INIT_WORK(&cache->warm[i].work, weight_cache_warm_fn);
+        queue_work(system_unbound_wq, &cache->warm[i].work);
+    }
+    cache->n_warm = n_workers;
+    
+    pr_info("🦙 Weight Cache: Warming %d layers on %d workers\n",
+            cache->n_layers, n_workers);
+}
+
+/* Set up the row store for the token embedding table */
+int llama_weight_cache_register_rows(struct llama_weight_cache *cache,
+                                     const struct ggml_tensor *t) {
+    if (!cache || !t || t->n_dims != 2 || cache->embd.rows)
+        return -EINVAL;
+    
+    cache->embd.rows = kvcalloc(t->ne[1], sizeof(float *), GFP_KERNEL);
+    if (!cache->embd.rows)
+        return -ENOMEM;
+    
+    cache->embd.n_rows = t->ne[1];
+    cache->embd.ne0 = t->ne[0];
+    cache->embd.n_cached = 0;
+    /* Publish src last - lookups key on it */
+    smp_store_release(&cache->embd.src, t);
+    
+    return 0;
+}
+
+/* Copy a cached embedding row to dst; false if it is not cached yet */
+bool llama_weight_cache_copy_row(struct llama_weight_cache *cache,
+                                 const struct ggml_tensor *t, int64_t row, float *dst) {
+    struct weight_cache_rows *embd = &cache->embd;
+    const float *src;
+    bool hit = false;
+    int idx;
+    
+    if (smp_load_acquire(&embd->src) != t || row < 0 || row >= embd->n_rows)
+        return false;
+    
+    idx = srcu_read_lock(&cache->srcu);
+    src = READ_ONCE(embd->rows[row]);
+    if (src) {
+        memcpy(dst, src, embd->ne0 * sizeof(float));
+        hit = true;
+    }
+    srcu_read_unlock(&cache->srcu, idx);
+    
+    if (hit)
+        this_cpu_inc(cache->stats->hits);
+    return hit;
+}
+
+/* Keep a freshly decoded embedding row, within the row and byte budgets */
+void llama_weight_cache_store_row(struct llama_weight_cache *cache,
+                                  const struct ggml_tensor *t, int64_t row,
+                                  const float *src) {
+    struct weight_cache_rows *embd = &cache->embd;
+    const size_t size = embd->ne0 * sizeof(float);
+    float *copy;
+    
+    if (smp_load_acquire(&embd->src) != t || row < 0 || row >= embd->n_rows ||
+        READ_ONCE(embd->rows[row]))
+        return;
+    
+    mutex_lock(&cache->cache_lock);
+    this_cpu_inc(cache->stats->misses);
     
-    if (entry->cached) {
-        atomic_dec(&entry->ref_count);
+    if (!cache->enabled || embd->rows[row] ||
+        embd->n_cached >= READ_ONCE(weight_cache_embd_rows) ||
+        cache->total_cache_size + size > llama_weight_cache_budget(cache))
+        goto out;
+    
+    copy = kvmalloc(size, WEIGHT_CACHE_GFP);
+    if (!copy)
+        goto out;
+    memcpy(copy, src, size);
+    
+    /* Readers copy the row locklessly - publish it fully written */
+    smp_store_release(&embd->rows[row], copy);
+    embd->n_cached++;
+    cache->total_cache_size += size;
+    
+out:
+    mutex_unlock(&cache->cache_lock);
+}
+
+void llama_weight_cache_read_stats(struct llama_weight_cache *cache,
+                                   u64 *hits, u64 *misses) {
+    int cpu;
+    
+    *hits = 0;
+    *misses = 0;
+    if (!cache->stats)
+        return;
+    
+    for_each_possible_cpu(cpu) {
+        const struct weight_cache_pcpu_stats *s = per_cpu_ptr(cache->stats, cpu);
+        
+        *hits += READ_ONCE(s->hits);
+        *misses += READ_ONCE(s->misses);
     }
 }
 
 /* Cache statistics */
 void llama_weight_cache_stats(struct llama_weight_cache *cache) {
+    u64 hits, misses, total;
+    
     if (!cache) return;
     
-    int hits = atomic_read(&cache->cache_hits);
-    int misses = atomic_read(&cache->cache_misses);
-    int total = hits + misses;
+    llama_weight_cache_read_stats(cache, &hits, &misses);
+    total = hits + misses;
     
     pr_info("🦙 Weight Cache Stats:\n");
     pr_info("  Total size: %zu MB / %zu MB\n", 
             cache->total_cache_size / (1024 * 1024),
-            cache->max_cache_size / (1024 * 1024));
-    pr_info("  Hit rate: %d%% (%d hits, %d misses)\n",
-            total > 0 ? (hits * 100) / total : 0,
+            llama_weight_cache_budget(cache) / (1024 * 1024));
+    pr_info("  Hit rate: %llu%% (%llu hits, %llu misses)\n",
+            total > 0 ? div64_u64(hits * 100, total) : 0,
             hits, misses);
-}
\ No newline at end of file
+    pr_info("  Evictions: %d (%d by reclaim)\n", atomic_read(&cache->cache_evictions),
+            atomic_read(&cache->shrink_evictions));
+    pr_info("  Not admitted: %d misses (budget full, served from source)\n",
+            atomic_read(&cache->cache_rejects));
+}
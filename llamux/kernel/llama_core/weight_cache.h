@@ -10,6 +10,10 @@
 #include <linux/types.h>
 #include <linux/mutex.h>
 #include <linux/atomic.h>
+#include <linux/percpu.h>
+#include <linux/srcu.h>
+#include <linux/workqueue.h>
+#include <linux/shrinker.h>
 #include "ggml_kernel.h"
 
 /* Weight types in transformer */
@@ -27,31 +31,106 @@ enum weight_type {
     MAX_WEIGHT_TYPES
 };
 
+/* Formats the cache may hold an entry in (weight_cache_format) */
+enum weight_cache_format {
+    WEIGHT_CACHE_FMT_AUTO = 0,  /* F32 for small tensors, Q8_0 for the rest */
+    WEIGHT_CACHE_FMT_F32,
+    WEIGHT_CACHE_FMT_F16,
+    WEIGHT_CACHE_FMT_Q8_0,
+};
+
+struct llama_weight_cache;
+
+/* A decoded copy, published to readers through SRCU */
+struct weight_cache_data {
+    void *buf;                 /* Cached copy in 'type' */
+    enum ggml_type type;       /* F32, F16 or Q8_0 */
+    size_t row_bytes;          /* Stride between rows of buf */
+    size_t size;               /* Size in bytes */
+    struct llama_weight_cache *cache;
+    bool reclaim;              /* Evicted by the shrinker */
+    struct rcu_head rcu;       /* Deferred free after eviction */
+};
+
 /* Cache entry for a single weight tensor */
 struct weight_cache_entry {
-    void *quantized;           /* Original quantized data */
-    float *dequantized;        /* Cached F32 version */
-    size_t size;              /* Size in bytes */
-    size_t n_elements;        /* Number of elements */
-    enum ggml_type type;      /* Original type (Q4_K, etc) */
-    bool cached;              /* Is dequantized version ready? */
-    atomic_t ref_count;       /* Reference count for concurrent access */
-    u64 last_access;          /* For LRU eviction if needed */
+    struct weight_cache_data __rcu *data;  /* NULL while not cached */
+    const void *quantized;     /* Original quantized data */
+    size_t n_elements;         /* Number of elements */
+    enum ggml_type type;       /* Original type (Q4_K, etc) */
+    const struct ggml_tensor *src;  /* Registered source tensor, for warm-up */
+    bool referenced;           /* CLOCK bit - set by readers, cleared by the hand */
+    bool filling;              /* Being decoded outside cache_lock */
+};
+
+/* Hit/miss counters, one copy per CPU so the hit path stays local */
+struct weight_cache_pcpu_stats {
+    u64 hits;
+    u64 misses;
+};
+
+/* Read-side handle - keeps the copy alive while a matmul uses it */
+struct weight_cache_ref {
+    const void *data;
+    enum ggml_type type;       /* Format of data - matmul dispatches on this */
+    size_t row_bytes;
+    int srcu_idx;
+};
+
+/*
+ * Row-granular F32 copy of the token embeddings. A prompt only touches a
+ * few hundred of the vocab rows, so rows are decoded on first use and
+ * kept. Rows are published with smp_store_release() under cache_lock,
+ * read locklessly under SRCU, and never evicted.
+ */
+struct weight_cache_rows {
+    float **rows;              /* Per-row copy, NULL until first use */
+    const struct ggml_tensor *src;
+    int64_t n_rows;
+    int64_t ne0;
+    int n_cached;              /* Under cache_lock */
+};
+
+#define WEIGHT_CACHE_MAX_LAYERS 128
+#define WEIGHT_CACHE_WARM_MAX 16
+
+/* One background warm-up worker */
+struct weight_cache_warm_work {
+    struct work_struct work;
+    struct llama_weight_cache *cache;
 };
 
 /* Global weight cache */
 struct llama_weight_cache {
     /* Cache entries per layer per weight type */
-    struct weight_cache_entry weights[128][MAX_WEIGHT_TYPES];  /* Support up to 128 layers */
+    struct weight_cache_entry weights[WEIGHT_CACHE_MAX_LAYERS][MAX_WEIGHT_TYPES];
     
     /* Global cache stats */
     size_t total_cache_size;
     size_t max_cache_size;
-    atomic_t cache_hits;
-    atomic_t cache_misses;
+    struct weight_cache_pcpu_stats __percpu *stats;
+    atomic_t cache_evictions;   /* All evictions, including reclaim */
+    atomic_t shrink_evictions;  /* Evictions driven by the shrinker */
+    atomic_t cache_rejects;     /* Demand misses left uncached, budget full */
+    atomic_long_t reclaimed_pages;  /* Freed for the shrinker, not yet reported */
+    struct shrinker shrinker;
+    bool reclaiming;           /* Shrinker is evicting, under cache_lock */
     
-    /* Synchronization */
+    /* Synchronization - cache_lock serializes fills and eviction */
     struct mutex cache_lock;
+    struct srcu_struct srcu;
+    int clock_hand;            /* Next slot the eviction sweep looks at */
+    
+    /* Token embedding rows (GET_ROWS) */
+    struct weight_cache_rows embd;
+    
+    /* Background warm-up - workers claim slots in layer order */
+    struct weight_cache_warm_work warm[WEIGHT_CACHE_WARM_MAX];
+    int n_warm;
+    atomic_t warm_next;
+    atomic_t warm_active;
+    atomic_t warm_filled;
+    bool warm_stop;
     
     /* Configuration */
     bool enabled;
@@ -64,20 +143,96 @@ int llama_weight_cache_init(struct llama_weight_cache *cache, int n_layers, size
 /* Free weight cache */
 void llama_weight_cache_free(struct llama_weight_cache *cache);
 
-/* Get cached weight or dequantize on demand */
-float *llama_weight_cache_get(struct llama_weight_cache *cache, 
-                             int layer, 
-                             enum weight_type type,
-                             const void *quantized_data,
-                             size_t n_elements,
-                             enum ggml_type quant_type);
+/*
+ * Get cached weight or decode it on demand into the policy's format.
+ * On success ref->data (in ref->type) is valid until
+ * llama_weight_cache_put(); the caller may sleep meanwhile.
+ */
+const void *llama_weight_cache_get(struct llama_weight_cache *cache, 
+                                   int layer, 
+                                   enum weight_type type,
+                                   const void *quantized_data,
+                                   int64_t ne0, int64_t ne1,
+                                   enum ggml_type quant_type,
+                                   struct weight_cache_ref *ref);
 
 /* Release weight reference */
-void llama_weight_cache_release(struct llama_weight_cache *cache,
-                               int layer,
-                               enum weight_type type);
+void llama_weight_cache_put(struct llama_weight_cache *cache,
+                            struct weight_cache_ref *ref);
+
+/*
+ * Tensor-keyed access. Model load tags each weight tensor with its
+ * (layer, type) slot once, so matmuls look entries up without parsing
+ * names or taking a lock.
+ */
+static inline void llama_weight_cache_tag(struct ggml_tensor *t, int layer,
+                                          enum weight_type type) {
+    if (t && layer >= 0 && layer < WEIGHT_CACHE_MAX_LAYERS)
+        t->cache_slot = 1 + layer * MAX_WEIGHT_TYPES + type;
+}
+
+const void *llama_weight_cache_get_tensor(struct llama_weight_cache *cache,
+                                          const struct ggml_tensor *t,
+                                          struct weight_cache_ref *ref);
+
+/* Layer of a tagged per-layer matrix (WQ..W3), or -1 */
+static inline int llama_weight_cache_layer(const struct ggml_tensor *t) {
+    const int slot = t ? t->cache_slot - 1 : -1;
+    
+    if (slot < 0 || slot % MAX_WEIGHT_TYPES > WEIGHT_W3)
+        return -1;
+    return slot / MAX_WEIGHT_TYPES;
+}
+
+/*
+ * What a matmul on t would stream right now: the cached copy if there is
+ * one, else the tensor's own data. No reference is taken, so the result
+ * is only good as a prefetch hint.
+ */
+const void *llama_weight_cache_peek(struct llama_weight_cache *cache,
+                                    const struct ggml_tensor *t, size_t *size);
+
+/*
+ * Warm-up: register each tagged tensor once its cache exists, then
+ * llama_weight_cache_warm() decodes them in the background, layer 0
+ * first, until the budget is full. Requests may run meanwhile; entries
+ * still being decoded are served from the source tensor.
+ */
+void llama_weight_cache_register(struct llama_weight_cache *cache,
+                                 const struct ggml_tensor *t);
+void llama_weight_cache_warm(struct llama_weight_cache *cache);
+
+/*
+ * Embedding rows: register the token embedding tensor, then GET_ROWS
+ * copies hot rows out of the cache and stores the ones it had to decode.
+ * Neither call needs an FPU region.
+ */
+int llama_weight_cache_register_rows(struct llama_weight_cache *cache,
+                                     const struct ggml_tensor *t);
+bool llama_weight_cache_copy_row(struct llama_weight_cache *cache,
+                                 const struct ggml_tensor *t, int64_t row, float *dst);
+void llama_weight_cache_store_row(struct llama_weight_cache *cache,
+                                  const struct ggml_tensor *t, int64_t row,
+                                  const float *src);
 
 /* Cache statistics */
 void llama_weight_cache_stats(struct llama_weight_cache *cache);
 
+/* Sum the per-CPU hit/miss counters */
+void llama_weight_cache_read_stats(struct llama_weight_cache *cache,
+                                   u64 *hits, u64 *misses);
+
+/* Evictions so far, total and by memory-pressure reclaim */
+static inline void llama_weight_cache_evictions(struct llama_weight_cache *cache,
+                                                int *total, int *reclaim) {
+    *total = atomic_read(&cache->cache_evictions);
+    *reclaim = atomic_read(&cache->shrink_evictions);
+}
+
+/* Whether a budget was set with weight_cache_mb */
+bool llama_weight_cache_configured(void);
+
+/* Current budget in bytes (weight_cache_mb module parameter overrides) */
+size_t llama_weight_cache_budget(const struct llama_weight_cache *cache);
+
 #endif /* _LLAMUX_WEIGHT_CACHE_H */
\ No newline at end of file
@@ -0,0 +1,31 @@
+/*
+ * Weight cache admission policy for Llamux
+ *
+ * A decode step reads every layer's weights in the same order, once per
+ * token. With a budget smaller than the model, evicting a cold entry to
+ * make room for a miss (LRU or CLOCK alike) throws out the entry needed
+ * again soonest, so every matmul misses and pays a full-tensor decode on
+ * top of the allocation. Fills therefore only take free budget: what fits
+ * first stays resident, the rest is read from the source weights, and
+ * only memory reclaim evicts.
+ *
+ * Free of kernel dependencies so it can be checked in userspace (see
+ * test/test_weight_cache.c).
+ */
+
+#ifndef _LLAMUX_WEIGHT_CACHE_POLICY_H
+#define _LLAMUX_WEIGHT_CACHE_POLICY_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdbool.h>
+#include <stddef.h>
+#endif
+
+/* Whether a size-byte copy fits next to used bytes without evicting */
+static inline bool weight_cache_admit(size_t used, size_t size, size_t budget) {
+    return size <= budget && used <= budget - size;
+}
+
+#endif /* _LLAMUX_WEIGHT_CACHE_POLICY_H */
@@ -0,0 +1,132 @@
+/*
+ * Userspace reference test for the integer Q4_K x Q8_K matmul path.
+ *
+ * Compares q4k_q8k_dot_int()/q4k_q8k_finalize() from quantize_k.h
+ * against a plain float dequantize-then-dot reference.
+ *
+ * Build: make -C test q4k_int
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "quantize_k.h"
+
+#define N_ROWS   64
+#define N_BLOCKS 20     /* 5120 columns, CodeLlama 13B n_embd */
+#define K        (N_BLOCKS * QK_K)
+
+// Float to FP16 (round to nearest, normal range only)
+static uint16_t fp32_to_fp16(float f) {
+    union { float f; uint32_t u; } v = { f };
+    uint32_t sign = (v.u >> 16) & 0x8000;
+    int32_t exp = ((v.u >> 23) & 0xff) - 127 + 15;
+    uint32_t mant = (v.u >> 13) & 0x3ff;
+
+    if (exp <= 0) return sign;
+    if (exp >= 31) return sign | 0x7bff;
+    if ((v.u >> 12) & 1) {
+        mant++;
+        if (mant == 0x400) { mant = 0; exp++; }
+    }
+    return sign | (exp << 10) | mant;
+}
+
+// Reference Q4_K dequantization in float
+static void dequant_ref(const struct block_q4_K *x, float *y, int nb) {
+    for (int i = 0; i < nb; i++) {
+        const float d = ggml_fp16_to_fp32(x[i].d);
+        const float dmin = ggml_fp16_to_fp32(x[i].dmin);
+        const uint8_t *q = x[i].qs;
+
+        for (int j = 0; j < QK_K / 64; j++) {
+            uint8_t sc0, m0, sc1, m1;
+            q4k_get_scale_min(2 * j, x[i].scales, &sc0, &m0);
+            q4k_get_scale_min(2 * j + 1, x[i].scales, &sc1, &m1);
+            for (int l = 0; l < 32; l++) {
+                y[i * QK_K + j * 64 + l]      = d * sc0 * (q[l] & 0xF) - dmin * m0;
+                y[i * QK_K + j * 64 + l + 32] = d * sc1 * (q[l] >> 4)  - dmin * m1;
+            }
+            q += 32;
+        }
+    }
+}
+
+static float frand(void) {
+    return (float)rand() / RAND_MAX * 2.0f - 1.0f;
+}
+
+static void fill_random_q4k(struct block_q4_K *x, int nb) {
+    for (int i = 0; i < nb; i++) {
+        x[i].d = fp32_to_fp16(0.001f + 0.01f * (frand() + 1.0f));
+        x[i].dmin = fp32_to_fp16(0.001f + 0.01f * (frand() + 1.0f));
+        for (int j = 0; j < K_SCALE_SIZE; j++) x[i].scales[j] = rand() & 0xff;
+        for (int j = 0; j < QK_K / 2; j++) x[i].qs[j] = rand() & 0xff;
+    }
+}
+
+int main(void) {
+    static struct block_q4_K w[N_ROWS][N_BLOCKS];
+    static struct block_q8_K a[N_BLOCKS];
+    static float act[K], act_q8[K], row[K];
+    int32_t isum[N_BLOCKS], msum[N_BLOCKS];
+    double max_err_q8 = 0.0, max_err_f32 = 0.0;
+    int failures = 0;
+
+    srand(1234);
+    for (int r = 0; r < N_ROWS; r++) fill_random_q4k(w[r], N_BLOCKS);
+    for (int k = 0; k < K; k++) act[k] = frand();
+
+    quantize_row_q8_K(act, a, K);
+    for (int i = 0; i < N_BLOCKS; i++)
+        for (int l = 0; l < QK_K; l++)
+            act_q8[i * QK_K + l] = a[i].d * a[i].qs[l];
+
+    // bsums must match the quants they summarise
+    for (int i = 0; i < N_BLOCKS; i++) {
+        for (int g = 0; g < QK_K / 16; g++) {
+            int s = 0;
+            for (int l = 0; l < 16; l++) s += a[i].qs[g * 16 + l];
+            if (s != a[i].bsums[g]) {
+                printf("FAIL: bsums[%d][%d] = %d, expected %d\n", i, g, a[i].bsums[g], s);
+                failures++;
+            }
+        }
+    }
+
+    for (int r = 0; r < N_ROWS; r++) {
+        double ref_q8 = 0.0, ref_f32 = 0.0, norm = 0.0;
+
+        dequant_ref(w[r], row, N_BLOCKS);
+        for (int k = 0; k < K; k++) {
+            ref_q8 += (double)row[k] * act_q8[k];
+            ref_f32 += (double)row[k] * act[k];
+            norm += fabs((double)row[k] * act[k]);
+        }
+
+        q4k_q8k_dot_int(w[r], a, N_BLOCKS, isum, msum);
+        float got = q4k_q8k_finalize(w[r], a, N_BLOCKS, isum, msum);
+
+        // Same quantized activations: only float rounding may differ
+        double err_q8 = fabs(got - ref_q8) / (norm + 1e-9);
+        // Original activations: bounded by Q8 quantization error
+        double err_f32 = fabs(got - ref_f32) / (norm + 1e-9);
+
+        if (err_q8 > max_err_q8) max_err_q8 = err_q8;
+        if (err_f32 > max_err_f32) max_err_f32 = err_f32;
+
+        if (err_q8 > 1e-5 || err_f32 > 1e-2) {
+            printf("FAIL: row %d got %f, ref(q8) %f, ref(f32) %f\n", r, got, ref_q8, ref_f32);
+            failures++;
+        }
+    }
+
+    printf("Q4_K x Q8_K integer path: %d rows x %d cols\n", N_ROWS, K);
+    printf("  max rel err vs Q8 reference:  %.3e\n", max_err_q8);
+    printf("  max rel err vs F32 reference: %.3e\n", max_err_f32);
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,152 @@
+/*
+ * Userspace test for the weight cache admission policy.
+ *
+ * Replays decode steps - every layer's weights in graph order, once per
+ * token - against a budget smaller than the model, filling misses
+ * through weight_cache_admit() from weight_cache_policy.h. For contrast
+ * it also runs the evict-to-fit CLOCK the cache used before, which on
+ * this cyclic pattern throws out the next weight needed and misses on
+ * nearly every matmul.
+ *
+ * Build: make -C test weight_cache
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "weight_cache_policy.h"
+
+#define N_LAYERS 22     /* TinyLlama */
+#define N_TYPES  7      /* wq wk wv wo w1 w2 w3 */
+#define N_SLOTS  (N_LAYERS * N_TYPES)
+#define N_TOKENS 16
+
+/* Q8_0 copy sizes in KB, TinyLlama 1.1B (n_embd 2048, n_ff 5632, 4 KV heads) */
+static const size_t type_kb[N_TYPES] = { 4352, 544, 544, 4352, 11968, 11968, 11968 };
+
+struct sim_cache {
+    bool present[N_SLOTS];
+    bool referenced[N_SLOTS];
+    size_t used;
+    size_t budget;
+    int hand;
+    bool evict;         /* Evict-to-fit CLOCK instead of admission */
+};
+
+static size_t slot_size(int slot) {
+    return type_kb[slot % N_TYPES] * 1024;
+}
+
+static bool clock_evict_one(struct sim_cache *c) {
+    for (int n = 0; n < 2 * N_SLOTS; n++) {
+        int slot = c->hand;
+
+        c->hand = (c->hand + 1) % N_SLOTS;
+        if (!c->present[slot])
+            continue;
+        if (c->referenced[slot]) {
+            c->referenced[slot] = false;
+            continue;
+        }
+        c->present[slot] = false;
+        c->used -= slot_size(slot);
+        return true;
+    }
+    return false;
+}
+
+/* One matmul's lookup; true on a hit */
+static bool access_slot(struct sim_cache *c, int slot) {
+    const size_t size = slot_size(slot);
+
+    if (c->present[slot]) {
+        c->referenced[slot] = true;
+        return true;
+    }
+
+    if (c->evict) {
+        while (c->used + size > c->budget)
+            if (!clock_evict_one(c))
+                return false;
+    } else if (!weight_cache_admit(c->used, size, c->budget)) {
+        return false;
+    }
+
+    c->present[slot] = true;
+    c->referenced[slot] = true;
+    c->used += size;
+    return false;
+}
+
+/* Hit rate over tokens after the first, which only fills */
+static double run(size_t budget, bool evict) {
+    struct sim_cache c;
+    long hits = 0, lookups = 0;
+
+    memset(&c, 0, sizeof(c));
+    c.budget = budget;
+    c.evict = evict;
+
+    for (int t = 0; t < N_TOKENS; t++) {
+        for (int slot = 0; slot < N_SLOTS; slot++) {
+            bool hit = access_slot(&c, slot);
+
+            if (c.used > c.budget) {
+                printf("FAIL: %zu bytes cached over a %zu byte budget\n", c.used, c.budget);
+                exit(1);
+            }
+            if (t > 0) {
+                hits += hit;
+                lookups++;
+            }
+        }
+    }
+
+    return (double)hits / lookups;
+}
+
+int main(void) {
+    size_t model = 0;
+    int failures = 0;
+
+    for (int slot = 0; slot < N_SLOTS; slot++)
+        model += slot_size(slot);
+
+    printf("Weight cache admission, %d tensors, %zu MB model\n", N_SLOTS, model >> 20);
+
+    for (int pct = 10; pct <= 100; pct += 30) {
+        size_t budget = model * pct / 100;
+        double admit = run(budget, false);
+        double clock = run(budget, true);
+
+        printf("  budget %3d%%: hit rate %5.1f%% admit, %5.1f%% evict-to-fit\n",
+               pct, admit * 100, clock * 100);
+
+        // What fits first stays: hits track the budget share
+        if (pct < 100 && admit < clock) {
+            printf("FAIL: admission below evict-to-fit at %d%%\n", pct);
+            failures++;
+        }
+        if (admit * 100 < pct - 15) {
+            printf("FAIL: admission hit rate %.1f%% far below the %d%% budget\n",
+                   admit * 100, pct);
+            failures++;
+        }
+    }
+
+    if (run(model, false) != 1.0) {
+        printf("FAIL: whole model in budget but not all hits\n");
+        failures++;
+    }
+    if (run(0, false) != 0.0 || weight_cache_admit(0, 1, 0)) {
+        printf("FAIL: zero budget admitted something\n");
+        failures++;
+    }
+    if (weight_cache_admit(10, (size_t)-1, 100)) {
+        printf("FAIL: oversized copy admitted\n");
+        failures++;
+    }
+
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures ? 1 : 0;
+}